@@ -0,0 +1,138 @@
+/*
+ * One-shot software alarms on top of HSTIMER0 (see alarm.h).
+ */
+#include "alarm.h"
+#include "hstimer.h"
+#include "interrupts.h"
+#include "irq.h"
+#include "timer.h"
+#include <stddef.h>
+#include <stdint.h>
+
+static struct {
+    alarm_t *pending;   // sorted by deadline, earliest first
+    bool initialized;
+} module;
+
+/*
+ * Tick comparison which survives the counter wrapping around.
+ */
+static bool before(unsigned long a, unsigned long b) {
+    return (long)(a - b) < 0;
+}
+
+/*
+ * Programs the hardware timer for the earliest pending alarm, or stops it if
+ * there is none. Interrupts must be off.
+ */
+static void program_timer(void) {
+    hstimer_disable(ALARM_HSTIMER);
+
+    if (module.pending == NULL)
+        return;
+
+    long usec = (long)(module.pending->deadline - timer_get_ticks()) / TICKS_PER_USEC;
+    if (usec < ALARM_MIN_USEC)
+        usec = ALARM_MIN_USEC;
+
+    hstimer_init(ALARM_HSTIMER, usec);
+    hstimer_enable(ALARM_HSTIMER);
+}
+
+/*
+ * Removes an alarm from the pending list. Interrupts must be off.
+ */
+static void unlink_alarm(alarm_t *alarm) {
+    for (alarm_t **p = &module.pending; *p != NULL; p = &(*p)->next) {
+        if (*p == alarm) {
+            *p = alarm->next;
+            break;
+        }
+    }
+
+    alarm->pending = false;
+    alarm->next = NULL;
+}
+
+/*
+ * Inserts an alarm in the pending list, keeping it sorted. Alarms with the same
+ * deadline fire in the order they were set. Interrupts must be off.
+ */
+static void insert_alarm(alarm_t *alarm) {
+    alarm_t **p = &module.pending;
+    while (*p != NULL && !before(alarm->deadline, (*p)->deadline))
+        p = &(*p)->next;
+
+    alarm->next = *p;
+    *p = alarm;
+    alarm->pending = true;
+}
+
+static void handle_timer(uintptr_t pc, void *aux_data) {
+    hstimer_interrupt_clear(ALARM_HSTIMER);
+
+    // run everything that is due; an alarm function may set alarms again,
+    // which is why the list is re-read every time
+    while (module.pending != NULL && !before(timer_get_ticks(), module.pending->deadline)) {
+        alarm_t *alarm = module.pending;
+        module.pending = alarm->next;
+        alarm->pending = false;
+        alarm->next = NULL;
+
+        alarm->fn(alarm->aux_data);
+    }
+
+    program_timer();
+}
+
+void alarm_init(void) {
+    if (module.initialized)
+        return;
+
+    module.pending = NULL;
+
+    hstimer_init(ALARM_HSTIMER, ALARM_MIN_USEC);
+    interrupts_register_handler(INTERRUPT_SOURCE_HSTIMER0, handle_timer, NULL);
+    interrupts_enable_source(INTERRUPT_SOURCE_HSTIMER0);
+
+    module.initialized = true;
+}
+
+void alarm_set(alarm_t *alarm, unsigned long usec, alarm_fn_t fn, void *aux_data) {
+    alarm_set_at(alarm, timer_get_ticks() + usec * TICKS_PER_USEC, fn, aux_data);
+}
+
+void alarm_set_at(alarm_t *alarm, unsigned long ticks, alarm_fn_t fn, void *aux_data) {
+    unsigned long flags = irq_save();
+
+    if (alarm->pending)
+        unlink_alarm(alarm);
+
+    alarm->deadline = ticks;
+    alarm->fn = fn;
+    alarm->aux_data = aux_data;
+    insert_alarm(alarm);
+
+    // only the head decides when the timer fires
+    if (module.pending == alarm)
+        program_timer();
+
+    irq_restore(flags);
+}
+
+void alarm_cancel(alarm_t *alarm) {
+    unsigned long flags = irq_save();
+
+    if (alarm->pending) {
+        bool was_first = module.pending == alarm;
+        unlink_alarm(alarm);
+        if (was_first)
+            program_timer();
+    }
+
+    irq_restore(flags);
+}
+
+bool alarm_pending(const alarm_t *alarm) {
+    return alarm->pending;
+}
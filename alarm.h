@@ -0,0 +1,84 @@
+#ifndef ALARM_H
+#define ALARM_H
+
+/*
+ * One-shot software alarms, all multiplexed on a single hardware timer
+ * (HSTIMER0). An alarm calls a function from the timer interrupt once its
+ * delay has passed, regardless of what the main loop is doing.
+ *
+ * The alarm_t is owned by the caller (usually embedded in the state of the
+ * module using it), so setting an alarm never allocates. Setting an alarm which
+ * is already pending moves it to the new deadline, which makes timeouts easy:
+ * set the alarm again every time there is activity, and it only fires after a
+ * quiet period.
+ *
+ * Alarm functions run in interrupt context: they must be short and must not
+ * block. They may set alarms (including their own).
+ *
+ * NOTE: Remember to call interrupts_init and interrupts_global_enable!
+ */
+
+#include <stdbool.h>
+
+#define ALARM_HSTIMER HSTIMER0
+
+// shortest delay the timer is programmed with, so that alarms which are already
+// due still get an interrupt
+#define ALARM_MIN_USEC 10
+
+typedef void (*alarm_fn_t)(void *aux_data);
+
+typedef struct alarm {
+    unsigned long deadline; // ticks
+    alarm_fn_t fn;
+    void *aux_data;
+    bool pending;
+    struct alarm *next;     // pending alarms, sorted by deadline
+} alarm_t;
+
+/*
+ * `alarm_init` sets up the hardware timer and its interrupt. Calling it more
+ * than once has no effect, so every module using alarms can call it.
+ */
+void alarm_init(void);
+
+/*
+ * `alarm_set` (re)arms an alarm
+ *
+ * If the alarm was already pending, its previous deadline is forgotten.
+ *
+ * @param alarm     the alarm, which must stay valid while pending
+ * @param usec      delay from now, in microseconds
+ * @param fn        function to call (from the interrupt) when it fires
+ * @param aux_data  passed to fn
+ */
+void alarm_set(alarm_t *alarm, unsigned long usec, alarm_fn_t fn, void *aux_data);
+
+/*
+ * `alarm_set_at` (re)arms an alarm for an absolute time, like alarm_set. Using
+ * the previous deadline plus a period, instead of a delay from now, keeps a
+ * sequence of alarms from drifting. A deadline in the past fires right away.
+ *
+ * @param alarm     the alarm, which must stay valid while pending
+ * @param ticks     when to fire, as returned by timer_get_ticks
+ * @param fn        function to call (from the interrupt) when it fires
+ * @param aux_data  passed to fn
+ */
+void alarm_set_at(alarm_t *alarm, unsigned long ticks, alarm_fn_t fn, void *aux_data);
+
+/*
+ * `alarm_cancel` disarms an alarm. Does nothing if it was not pending.
+ *
+ * @param alarm     the alarm
+ */
+void alarm_cancel(alarm_t *alarm);
+
+/*
+ * `alarm_pending` checks whether an alarm is set and has not fired yet.
+ *
+ * @param alarm     the alarm
+ * @return          `true` if it will still fire
+ */
+bool alarm_pending(const alarm_t *alarm);
+
+#endif
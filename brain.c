@@ -1,11 +1,19 @@
+#include "buzz.h"
+#include "buzz_player.h"
 #include "chess_commands.h"
+#include "codebook.h"
 #include "interrupts.h"
 #include "jnxu.h"
-#include "malloc.h"
+#include "move_entry.h"
+#include "movegen.h"
+#include "transport.h"
 #include "timer.h"
 #include "uart.h"
 #include "chess.h"
 #include "chess_gui.h"
+#include "evloop.h"
+#include "printf.h"
+#include "ringq.h"
 #include "strings.h"
 #include <stddef.h>
 #include <stdint.h>
@@ -13,140 +21,842 @@
 #define BT_MODE BT_EXT_ROLE_SUBORDINATE
 #define BT_MAC  NULL
 
-#define CLAMP(x, min, max) ((x) > (max) ? (max) : ((x) < (min) ? (min) : (x)))
+// how moves are buzzed to the wearer (see codebook.h)
+#define BRAIN_CODEBOOK "unary"
 
-typedef enum {
-    LISTENING_X0 = 0,
-    LISTENING_Y0,
-    LISTENING_X1,
-    LISTENING_Y1,
-    LISTENING_PROMOTION,
-} brain_state_t;
+// buzz moves as their index among the legal moves (see movegen.h), which the
+// hand expands back into the move, instead of with BRAIN_CODEBOOK
+#define BRAIN_MOVE_INDEX 1
+
+// the cursor only stops where a legal move can go (see move_entry_follow)
+#define BRAIN_SNAP_CURSOR 1
+
+// deadline of the host's commands in the main loop (see evloop.h)
+#define BRAIN_COMMAND_BUDGET_USEC (20 * 1000)
+
+// messages to buzz remembered, to name them in the hand's reports
+#define BRAIN_SENT_LOG 8
+
+// deadline of the engine's replies in the main loop (see evloop.h)
+#define BRAIN_ENGINE_BUDGET_USEC (20 * 1000)
+
+// how long to wait for the engine before giving up on a move
+#define BRAIN_ENGINE_TIMEOUT_USEC (30 * 1000 * 1000)
+
+// the engine's replies to the opponent's likely moves remembered at most
+#define BRAIN_CACHE_SIZE 8
+
+// messages from the hand waiting for the main loop, and the longest one kept
+// (a CMD_DELIVERY with every report)
+#define BRAIN_HAND_QUEUE_LENGTH 16
+#define BRAIN_HAND_MESSAGE_LEN (2 * BUZZ_PLAYER_REPORT_LENGTH)
+
+// deadline of the hand's messages in the main loop (see evloop.h)
+#define BRAIN_HAND_BUDGET_USEC (10 * 1000)
+
+typedef struct {
+    char move[6];   // the opponent's
+    char reply[6];  // the engine's
+} cached_reply_t;
+
+// a message from the hand, received in the interrupt and handled by fn in the
+// main loop
+typedef struct {
+    jnxu_handler_t fn;
+    uint8_t len;
+    uint8_t message[BRAIN_HAND_MESSAGE_LEN];
+} hand_message_t;
+
+RINGQ_DECLARE(hand_queue, hand_message_t, BRAIN_HAND_QUEUE_LENGTH)
 
 static struct {
-    volatile int cursor_x;
-    volatile int cursor_y;
-    volatile int cursor_promotion;
-    volatile brain_state_t state;
-    int move[5];
-} module;
+    move_entry_t entry;
+    const codebook_t *codebook;
+    movegen_position_t position;
+    bool in_sync;   // the position is the game's (and so the hand's)
+    uint8_t next_tag;   // of the next message to buzz (see CMD_DELIVERY)
+    char sent[BRAIN_SENT_LOG][6];
 
-static const char PROMOTION_PIECE_NAMES[] = { 'r', 'n', 'b', 'q' };
+    // the engine is thinking about pending_move ("" for its first move)
+    bool pending;
+    char pending_move[8];
+    bool cancelling;    // replies are dropped until the engine says CANCELLED
 
-static void reset_cursor(void) {
-    module.cursor_x = 0;
-    module.cursor_y = CHESS_SIZE - 1;
-    module.cursor_promotion = -1;
-}
+    // the engine's replies, computed ahead for this position
+    cached_reply_t cache[BRAIN_CACHE_SIZE];
+    int ncache;
+    char played[8];     // cached reply played, for the engine to confirm ("" if none)
+    movegen_position_t before_played;
+    int timeout_task;
 
-static void paint_cursor(void) {
-    bool is_piece_moved = module.state == LISTENING_X1 || module.state == LISTENING_Y1;
+    // the hand's messages, queued by the interrupt so that the state above is
+    // only ever touched by the main loop
+    hand_queue_t hand_messages;
+} module;
 
+// played (urgently) when the host says the move entered is not valid
+static const uint8_t NOPE_SYMBOLS[] = {
+    CODEBOOK_LONG, CODEBOOK_GAP, CODEBOOK_LONG, CODEBOOK_GAP, CODEBOOK_LONG,
+};
+
+static const char *const OUTCOME_NAMES[] = {
+    "delivered", "cut", "dropped", "rejected",
+};
+
+/*
+ * Draws the cursor at a square, from the wearer's side of the board.
+ */
+static void paint_square(int x, int y, bool is_piece_moved) {
 #if PLAYING == WHITE
-    int visual_cursor_x = module.cursor_x;
-    int visual_cursor_y = module.cursor_y;
+    chess_gui_draw_cursor(x, y, is_piece_moved);
 #else
-    int visual_cursor_x = CHESS_SIZE - module.cursor_x - 1;
-    int visual_cursor_y = CHESS_SIZE - module.cursor_y - 1;
+    chess_gui_draw_cursor(CHESS_SIZE - x - 1, CHESS_SIZE - y - 1, is_piece_moved);
 #endif
-    chess_gui_draw_cursor(visual_cursor_x, visual_cursor_y, is_piece_moved);
+}
+
+static void paint_cursor(void) {
+    paint_square(module.entry.cursor_x, module.entry.cursor_y,
+            move_entry_piece_chosen(&module.entry));
+}
+
+/*
+ * Draws the move being entered, after it changed.
+ *
+ * @param was_chosen    whether the from square was selected before
+ * @param was_promotion whether the promotion menu was showing before
+ */
+static void show_entry(bool was_chosen, bool was_promotion) {
+    const move_entry_t *entry = &module.entry;
+
+    if (entry->state == MOVE_ENTRY_PROMOTION) {
+        chess_gui_promote(entry->cursor_promotion);
+        return;
+    }
+    if (was_promotion)
+        chess_gui_promote(-1);
+
+    if (entry->ncandidates > 0)
+        chess_gui_candidate_cursor(entry->state == MOVE_ENTRY_CANDIDATE ?
+                entry->cursor_candidate : -1);
+    if (entry->state == MOVE_ENTRY_CANDIDATE)
+        return;
+
+    // the screen marks where the cursor was when the piece was chosen, which
+    // is the from square only if it is drawn there first
+    if (move_entry_piece_chosen(entry) && !was_chosen)
+        paint_square(entry->move[0], entry->move[1], false);
+    paint_cursor();
+}
+
+static void move_cursor(int motion, bool other_axis) {
+    bool was_chosen = move_entry_piece_chosen(&module.entry);
+    move_entry_cursor(&module.entry, motion, other_axis);
+    show_entry(was_chosen, false);
+}
+
+/*
+ * Signed number of squares in a CMD_CURSOR or CMD_CURSOR_ALT message.
+ */
+static int cursor_motion(const uint8_t *message, size_t len) {
+    // older hands send only the direction, meaning a single square
+    int count = (len >= 2) ? message[1] : 1;
+    return (message[0] == MOTION_CW) ? count : -count;
 }
 
 static void update_cursor(void *aux_data, const uint8_t *message, size_t len) {
     if (len < 1) return;
+    move_cursor(cursor_motion(message, len), false);
+}
+
+static void update_cursor_alt(void *aux_data, const uint8_t *message, size_t len) {
+    if (len < 1) return;
+    move_cursor(cursor_motion(message, len), true);
+}
 
-    int motion = (message[0] == MOTION_CW) ? 1 : -1;
+/*
+ * Sends the hand a message it will buzz, with its tag in front, and remembers
+ * what it was by the tag. A message which does not arrive is simply never
+ * reported.
+ *
+ * @param what      name for the reports, like the move (up to 5 characters)
+ */
+static void send_to_buzz(uint8_t cmd, const uint8_t *message, size_t len, const char *what) {
+    uint8_t tagged[1 + BUZZ_MAX_PROGRAM];
+    if (len >= sizeof(tagged))
+        return;
 
-    switch (module.state) {
-        case LISTENING_X0:
-        case LISTENING_X1:
-            module.cursor_x += motion;
-            break;
-        case LISTENING_Y0:
-        case LISTENING_Y1:
-            module.cursor_y += motion;
-            break;
-        case LISTENING_PROMOTION:
-            module.cursor_promotion += motion;
-            break;
+    uint8_t tag = module.next_tag++;
+    tagged[0] = tag;
+    memcpy(tagged + 1, message, len);
+
+    char *name = module.sent[tag % BRAIN_SENT_LOG];
+    int i = 0;
+    for (; i < 5 && what[i] != '\0' && what[i] != '\n'; i++)
+        name[i] = what[i];
+    name[i] = '\0';
+
+    jnxu_send(cmd, tagged, 1 + len);
+}
+
+/*
+ * Prints what became of the messages the hand was asked to buzz.
+ */
+static void delivery_handler(void *aux_data, const uint8_t *message, size_t len) {
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        uint8_t tag = message[i], outcome = message[i + 1];
+        if (outcome >= sizeof(OUTCOME_NAMES) / sizeof(*OUTCOME_NAMES))
+            continue;
+
+        // tags are only remembered for a while
+        bool known = (uint8_t)(module.next_tag - tag - 1) < BRAIN_SENT_LOG;
+        printf("Hand: %s %s\n", known ? module.sent[tag % BRAIN_SENT_LOG] : "?",
+                OUTCOME_NAMES[outcome]);
     }
+}
+
+/*
+ * Tells the wearer that the move they entered is not valid, cutting whatever
+ * the hand is buzzing.
+ */
+static void send_nope(void) {
+    uint8_t program[BUZZ_MAX_PROGRAM];
+    size_t len = buzz_compile(NOPE_SYMBOLS, sizeof(NOPE_SYMBOLS), program, sizeof(program));
+    if (len > 0)
+        send_to_buzz(CMD_BUZZ_URGENT, program, len, "NOPE");
+}
 
-    module.cursor_x = CLAMP(module.cursor_x, 0, 7);
-    module.cursor_y = CLAMP(module.cursor_y, 0, 7);
-    module.cursor_promotion = CLAMP(module.cursor_promotion, -1, 3);
+/*
+ * Compiles the engine's move into a buzz program and sends it to the hand.
+ */
+static void send_buzz(const char *move) {
+    codebook_move_t parsed;
+    if (!codebook_parse_move(move, PLAYING, &parsed))
+        return;
 
-    if (module.state == LISTENING_PROMOTION) {
-        chess_gui_promote(module.cursor_promotion);
-    } else {
-        paint_cursor();
+    uint8_t symbols[CODEBOOK_MAX_SYMBOLS];
+    size_t n = module.codebook->encode(&parsed, symbols, sizeof(symbols));
+
+    uint8_t program[BUZZ_MAX_PROGRAM];
+    size_t len = buzz_compile(symbols, n, program, sizeof(program));
+    if (len > 0)
+        send_to_buzz(CMD_BUZZ, program, len, move);
+}
+
+/*
+ * Looks up a move played in the game among the legal moves of the brain's
+ * position. If it is not there, the position is out of sync, and is not used
+ * anymore.
+ *
+ * @return          its index, -1 if it is not legal
+ */
+static int find_move(const char *move, movegen_move_t *parsed, size_t *count) {
+    if (!module.in_sync)
+        return -1;
+
+    int index = movegen_find(&module.position, move, parsed, count);
+    if (index < 0) {
+        printf("Position out of sync (%s is not legal)\n", move);
+        module.in_sync = false;
+        move_entry_follow(&module.entry, NULL, PLAYING);
     }
+    return index;
 }
 
-static void button_press(void *aux_data, const uint8_t *message, size_t len) {
-    switch (module.state) {
-        case LISTENING_X1:
-        case LISTENING_X0:
-            module.move[module.state] = module.cursor_x;
-            break;
-        
-        case LISTENING_Y1:
-            module.cursor_promotion = -1;
-        case LISTENING_Y0:
-            module.move[module.state] = module.cursor_y;
-            break;
+/*
+ * Plays a move on the brain's position, without telling the hand.
+ */
+static void play_move(const char *move) {
+    movegen_move_t parsed;
+    if (find_move(move, &parsed, NULL) >= 0)
+        movegen_apply(&module.position, &parsed);
+}
 
-        case LISTENING_PROMOTION:
-            {
-                char opp_move[6];
+/*
+ * Plays a move on the brain's position and sends it to the hand as its index,
+ * for the hand to play on its own position (and buzz, for CMD_MOVE_INDEX).
+ *
+ * @return          `false` if the move is not legal in the position, which
+ *                  is then out of sync
+ */
+static bool send_indexed(uint8_t cmd, const char *move) {
+    movegen_move_t parsed;
+    size_t count;
+    int index = find_move(move, &parsed, &count);
+    if (index < 0)
+        return false;
 
-#if PLAYING == WHITE
-                opp_move[0] = 'a' + module.move[0];
-                opp_move[1] = '1' + module.move[1];
-                opp_move[2] = 'a' + module.move[2];
-                opp_move[3] = '1' + module.move[3];
+    char uci[6];
+    movegen_format(&parsed, uci);
+
+    uint8_t message[2 + sizeof(uci)] = { index, count };
+    size_t len = strlen(uci);
+    memcpy(message + 2, uci, len);
+    if (cmd == CMD_MOVE_INDEX)
+        send_to_buzz(cmd, message, 2 + len, uci);
+    else
+        jnxu_send(cmd, message, 2 + len);
+
+    movegen_apply(&module.position, &parsed);
+    return true;
+}
+
+/*
+ * Sends the engine's move to the hand, to be buzzed to the wearer.
+ */
+static void send_your_move(const char *move) {
+#if BRAIN_MOVE_INDEX
+    if (module.in_sync && send_indexed(CMD_MOVE_INDEX, move))
+        return;
 #else
-                opp_move[0] = 'h' - module.move[0];
-                opp_move[1] = '8' - module.move[1];
-                opp_move[2] = 'h' - module.move[2];
-                opp_move[3] = '8' - module.move[3];
+    play_move(move);
 #endif
+    send_buzz(move);
+}
 
-                if (module.cursor_promotion >= 0) {
-                    opp_move[4] = PROMOTION_PIECE_NAMES[module.cursor_promotion];
-                    opp_move[5] = '\n';
-                } else {
-                    opp_move[4] = '\n';
-                }
+/*
+ * Lets the hand know about the opponent's move, to keep track of the game.
+ */
+static void send_opp_move(const char *move) {
+#if BRAIN_MOVE_INDEX
+    if (module.in_sync)
+        send_indexed(CMD_MOVE_PLAYED, move);
+#else
+    play_move(move);
+#endif
+}
 
-                chess_send_move(opp_move); // send move to stockfish
+static void reset_move(void) {
+    move_entry_reset(&module.entry);
+    paint_cursor();
+    chess_gui_promote(-1);
+    if (module.entry.state == MOVE_ENTRY_CANDIDATE)
+        chess_gui_candidate_cursor(module.entry.cursor_candidate);
+}
 
-                char your_move[8];
-                chess_get_move(your_move, sizeof(your_move)); // get stockfish move 
+/*
+ * Sets the opponent's likely moves, offered first when entering their move,
+ * here and on the hand. Those which are not legal are left out.
+ *
+ * @param list      the moves in UCI notation, separated by spaces, the most
+ *                  likely first
+ */
+static void set_candidates(const char *list) {
+    movegen_move_t moves[MOVE_ENTRY_MAX_CANDIDATES];
+    char names[MOVE_ENTRY_MAX_CANDIDATES][6];
+    const char *name_list[MOVE_ENTRY_MAX_CANDIDATES];
+    uint8_t message[1 + MOVE_ENTRY_MAX_CANDIDATES];
+    size_t count = 0;
+    int n = 0;
 
-                if (strcmp(your_move, "NOPE\n") != 0) {
-                    chess_gui_update(opp_move, false);
-                    chess_gui_update(your_move, true);
-                    jnxu_send(CMD_MOVE, (const uint8_t *)your_move, 6); // send stockfish move to hand
-                }
+    if (!module.in_sync)
+        return;
 
-                reset_cursor();
-                paint_cursor();
-                chess_gui_promote(-1);
-            }
+    const char *p = list;
+    while (n < MOVE_ENTRY_MAX_CANDIDATES) {
+        char uci[6] = "";
+        int len = 0;
+
+        while (*p == ' ' || *p == '\n')
+            p++;
+        for (; *p != '\0' && *p != ' ' && *p != '\n'; p++, len++) {
+            if (len < 5)
+                uci[len] = *p;
+        }
+        if (len == 0)
             break;
+
+        int index = movegen_find(&module.position, uci, &moves[n], &count);
+        if (index < 0 || len > 5)
+            continue;
+
+        movegen_format(&moves[n], names[n]);
+        name_list[n] = names[n];
+        message[1 + n] = index;
+        n++;
+    }
+
+    move_entry_candidates(&module.entry, moves, n, PLAYING);
+    chess_gui_candidates(name_list, n);
+    if (!move_entry_piece_chosen(&module.entry))
+        reset_move();
+
+#if BRAIN_MOVE_INDEX
+    message[0] = count;
+    if (n > 0)
+        jnxu_send(CMD_CANDIDATES, message, 1 + n);
+#endif
+}
+
+/*
+ * Forgets the opponent's likely moves, and the replies to them, once they
+ * have moved.
+ */
+static void clear_candidates(void) {
+    move_entry_candidates(&module.entry, NULL, 0, PLAYING);
+    chess_gui_candidates(NULL, 0);
+    module.ncache = 0;
+}
+
+/*
+ * Remembers the engine's reply to one of the opponent's likely moves. It is
+ * left out if either move is not legal.
+ *
+ * @param entry     the opponent's move and the reply, in UCI notation,
+ *                  separated by a space ("e7e5 g1f3")
+ */
+static void add_cached_reply(const char *entry) {
+    if (!module.in_sync || module.ncache == BRAIN_CACHE_SIZE)
+        return;
+
+    const char *reply = entry;
+    while (*reply != ' ' && *reply != '\0')
+        reply++;
+    if (*reply == '\0' || reply - entry > 5)
+        return;
+
+    char uci[6] = "";
+    memcpy(uci, entry, reply - entry);
+
+    movegen_move_t move, answer;
+    if (movegen_find(&module.position, uci, &move, NULL) < 0)
+        return;
+
+    movegen_position_t after = module.position;
+    movegen_apply(&after, &move);
+    if (movegen_find(&after, reply + 1, &answer, NULL) < 0)
+        return;
+
+    cached_reply_t *cached = &module.cache[module.ncache++];
+    movegen_format(&move, cached->move);
+    movegen_format(&answer, cached->reply);
+}
+
+/*
+ * Looks up the engine's reply to a move of the opponent.
+ *
+ * @return          the reply, NULL if it was not computed ahead
+ */
+static const char *cached_reply(const char *opp_move) {
+    movegen_move_t move;
+    if (!module.in_sync || movegen_find(&module.position, opp_move, &move, NULL) < 0)
+        return NULL;
+
+    char uci[6];
+    movegen_format(&move, uci);
+    for (int i = 0; i < module.ncache; i++) {
+        if (strcmp(module.cache[i].move, uci) == 0)
+            return module.cache[i].reply;
+    }
+    return NULL;
+}
+
+/*
+ * Shows the pending move and the engine's reply to it, and forwards both to
+ * the hand.
+ *
+ * @param your_move the engine's move, with newline
+ */
+static void play_reply(const char *your_move) {
+    if (strcmp(your_move, "NOPE\n") == 0) {
+        send_nope();
+        return;
+    }
+
+    if (module.pending_move[0] != '\0') {
+        chess_gui_update(module.pending_move, false);
+        send_opp_move(module.pending_move);
+    }
+    chess_gui_update(your_move, true);
+    send_your_move(your_move); // send stockfish move to hand
+}
+
+/*
+ * Sends the opponent's move to the host, and starts over with the next move.
+ * The engine's reply is handled by handle_reply whenever it arrives, so the
+ * wearers are not kept waiting while it thinks. Only one move is sent at a
+ * time: while the engine is busy, the move is refused. So is a move which is
+ * not legal, without asking the engine.
+ *
+ * If the engine computed its reply ahead, the reply is played right away, and
+ * sent to the host with the move, for the engine to play it too and confirm.
+ *
+ * @param opp_move  the move in UCI notation, without newline
+ */
+static void submit_move(const char *opp_move) {
+    if (module.in_sync && movegen_find(&module.position, opp_move, NULL, NULL) < 0) {
+        printf("Illegal move %s refused\n", opp_move);
+        send_nope();
+        reset_move();
+        return;
+    }
+
+    if (module.pending || module.cancelling) {
+        printf("Engine busy, %s refused\n", opp_move);
+        send_nope();
+        reset_move();
+        return;
+    }
+
+    char line[8] = "";
+    strlcat(line, opp_move, sizeof(line) - 1);
+    strlcat(line, "\n", sizeof(line));
+    memcpy(module.pending_move, line, sizeof(line));
+
+    const char *reply = cached_reply(opp_move);
+    if (reply != NULL) {
+        char both[16] = "";
+        strlcat(both, opp_move, sizeof(both));
+        strlcat(both, " ", sizeof(both));
+        strlcat(both, reply, sizeof(both));
+        strlcat(both, "\n", sizeof(both));
+        chess_send_move(both); // stockfish plays the reply too
+
+        module.played[0] = '\0';
+        strlcat(module.played, reply, sizeof(module.played));
+        strlcat(module.played, "\n", sizeof(module.played));
+        module.before_played = module.position;
+        play_reply(module.played);
+    } else {
+        chess_send_move(line); // send move to stockfish
+        module.played[0] = '\0';
+    }
+
+    module.pending = true;
+    evloop_schedule(module.timeout_task, BRAIN_ENGINE_TIMEOUT_USEC);
+
+    clear_candidates();
+    reset_move();
+}
+
+/*
+ * Asks the engine to take back the pending request. Replies are dropped until
+ * it confirms (see handle_reply).
+ */
+static void take_back(void) {
+    module.pending = false;
+    module.cancelling = true;
+    evloop_cancel(module.timeout_task);
+    chess_cancel_move();
+}
+
+/*
+ * Waits for the engine's first move, which it plays on its own once the game
+ * starts (or once the previous one was taken back).
+ */
+static void request_first_move(void) {
+    module.pending_move[0] = '\0';
+    module.pending = true;
+    evloop_schedule(module.timeout_task, BRAIN_ENGINE_TIMEOUT_USEC);
+}
+
+/*
+ * Takes back the move the engine is thinking about, if any. Its reply, if it
+ * comes anyway, is dropped. The engine's first move is not taken back, and
+ * neither is a move whose reply was already played.
+ */
+static void cancel_request(void) {
+    if (!module.pending || module.pending_move[0] == '\0' || module.played[0] != '\0')
+        return;
+
+    take_back();
+}
+
+/*
+ * Takes back the last moves on the screen and on the hand's position, once
+ * the brain's position is back to where they were played from.
+ *
+ * @param n         how many, at most CMD_TAKEBACK_MAX
+ */
+static void take_back_moves(int n) {
+    chess_gui_takeback(n);
+
+#if BRAIN_MOVE_INDEX
+    if (!module.in_sync)
+        return;
+
+    movegen_move_t moves[MOVEGEN_MAX_MOVES];
+    uint8_t message[2] = { n, movegen_generate(&module.position, moves) };
+    jnxu_send(CMD_TAKEBACK, message, sizeof(message));
+#endif
+}
+
+/*
+ * The engine answered something else than the reply already played from the
+ * cache (which it should not). What the hand is buzzing is cut, the reply is
+ * taken back (here, on the screen and on the hand), and the engine's answer is
+ * sent instead. If the engine refused the opponent's move, that is taken back
+ * too.
+ *
+ * @param reply     the engine's answer, with newline
+ */
+static void correct_reply(const char *reply) {
+    printf("Engine answered %s", reply);
+    printf(" instead of %s", module.played);
+
+    send_nope();
+    module.position = module.before_played;
+    if (strcmp(reply, "NOPE\n") == 0) {
+        take_back_moves(2);
+        return;
+    }
+
+    play_move(module.pending_move);
+    take_back_moves(1);
+    chess_gui_update(reply, true);
+    send_your_move(reply);
+}
+
+static bool reply_ready(void *aux_data) {
+    return chess_has_move();
+}
+
+/*
+ * Handles a line from the engine: the reply to the pending move (or its
+ * confirmation, if it was played from the cache), or the end of a
+ * cancellation.
+ */
+static void handle_reply(void *aux_data) {
+    char reply[16];
+    if (!chess_poll_move(reply, sizeof(reply)))
+        return;
+
+    if (module.cancelling) {
+        if (strcmp(reply, "CANCELLED\n") == 0) {
+            module.cancelling = false;
+            if (module.pending_move[0] == '\0')
+                request_first_move(); // the engine plays it again
+        }
+    } else if (module.pending) {
+        module.pending = false;
+        evloop_cancel(module.timeout_task);
+
+        if (module.played[0] == '\0')
+            play_reply(reply);
+        else if (strcmp(reply, module.played) != 0)
+            correct_reply(reply);
+        module.played[0] = '\0';
+    } else {
+        printf("Unexpected from engine: %s", reply);
+    }
+}
+
+/*
+ * The engine took too long: the move is taken back, and the wearer is told
+ * to enter it again. The engine's first move is taken back too, and asked for
+ * again once the engine confirms.
+ */
+static void engine_timeout(void *aux_data) {
+    if (!module.pending)
+        return;
+
+    printf("Engine timed out\n");
+    if (module.played[0] != '\0') {
+        // already played, it cannot be taken back anymore
+        module.pending = false;
+        module.played[0] = '\0';
+    } else if (module.pending_move[0] != '\0') {
+        cancel_request();
+        send_nope();
+    } else {
+        take_back();
+    }
+}
+
+/*
+ * Submits the move entered with the brain's own state machine.
+ */
+static void submit_entry(void) {
+    char opp_move[6];
+    move_entry_uci(&module.entry, PLAYING, opp_move);
+    submit_move(opp_move);
+}
+
+static void button_press(void *aux_data, const uint8_t *message, size_t len) {
+    bool was_chosen = move_entry_piece_chosen(&module.entry);
+    if (move_entry_press(&module.entry)) {
+        submit_entry();
+        return;
     }
 
-    module.state = (module.state + 1) % 5; // next state
+    show_entry(was_chosen, false); // show selected on button press
+}
 
-    if (module.state == LISTENING_X1) { // show selected on button bress
-        paint_cursor();
+/*
+ * Confirms both coordinates of the square under the cursor at once. At the
+ * destination square, the move is submitted right away (without promotion).
+ */
+static void confirm_square(void *aux_data, const uint8_t *message, size_t len) {
+    bool was_chosen = move_entry_piece_chosen(&module.entry);
+    if (move_entry_confirm(&module.entry)) {
+        submit_entry();
+        return;
     }
+
+    show_entry(was_chosen, false); // show selected
+}
+
+/*
+ * Starts the move over, taking it back if the engine is still thinking about
+ * it.
+ */
+static void reset_handler(void *aux_data, const uint8_t *message, size_t len) {
+    cancel_request();
+    reset_move();
+}
+
+/*
+ * A move entered on the hand, in UCI notation (see CMD_SUBMIT).
+ */
+static void submit_handler(void *aux_data, const uint8_t *message, size_t len) {
+    char opp_move[6] = "";
+    if (len < 4 || len > 5)
+        return;
+
+    memcpy(opp_move, message, len);
+    submit_move(opp_move);
+}
+
+/*
+ * Shows the cursor of the hand's move entry (see CMD_CURSOR_STATE).
+ */
+static void cursor_state_handler(void *aux_data, const uint8_t *message, size_t len) {
+    if (len < 6 || message[0] > MOVE_ENTRY_CANDIDATE)
+        return;
+
+    move_entry_t *entry = &module.entry;
+    bool was_chosen = move_entry_piece_chosen(entry);
+    bool was_promotion = entry->state == MOVE_ENTRY_PROMOTION;
+
+    entry->state = message[0];
+    entry->cursor_x = message[1] & 7;
+    entry->cursor_y = message[2] & 7;
+    entry->cursor_promotion = (int)message[3] - 1;
+    entry->move[0] = message[4] & 7;
+    entry->move[1] = message[5] & 7;
+    entry->cursor_candidate = (len >= 7) ? message[6] : 0;
+
+    show_entry(was_chosen, was_promotion);
+}
+
+// handlers of the hand's messages, run by handle_hand_message
+static const struct {
+    uint8_t cmd;
+    jnxu_handler_t fn;
+} HAND_HANDLERS[] = {
+    { CMD_CURSOR, update_cursor },
+    { CMD_PRESS, button_press },
+    { CMD_RESET_MOVE, reset_handler },
+    { CMD_CONFIRM, confirm_square },
+    { CMD_CURSOR_ALT, update_cursor_alt },
+    { CMD_SUBMIT, submit_handler },
+    { CMD_CURSOR_STATE, cursor_state_handler },
+    { CMD_DELIVERY, delivery_handler },
+};
+
+/*
+ * JNXU handler (in the interrupt) of every message from the hand: queues it,
+ * along with the function which handles it in the main loop. Those draw, send
+ * and talk to the engine, which would take too long in the interrupt and race
+ * with the main loop doing the same. A message which does not fit is dropped
+ * (the queue counts it when full).
+ *
+ * @param aux_data  index of the message's entry in HAND_HANDLERS
+ */
+static void queue_hand_message(void *aux_data, const uint8_t *message, size_t len) {
+    if (len > BRAIN_HAND_MESSAGE_LEN)
+        return;
+
+    hand_message_t *queued = hand_queue_claim(&module.hand_messages);
+    if (queued == NULL)
+        return;
+
+    queued->fn = HAND_HANDLERS[(uintptr_t)aux_data].fn;
+    queued->len = len;
+    memcpy(queued->message, message, len);
+    hand_queue_publish(&module.hand_messages);
 }
 
-static void reset_move(void *aux_data, const uint8_t *message, size_t len) {
-    module.state = LISTENING_X0;
-    reset_cursor();
-    chess_gui_draw_cursor(module.cursor_x, module.cursor_y, false);
+static bool hand_message_ready(void *aux_data) {
+    return !hand_queue_empty(&module.hand_messages);
+}
+
+static void handle_hand_message(void *aux_data) {
+    hand_message_t message;
+    if (hand_queue_dequeue(&module.hand_messages, &message))
+        message.fn(NULL, message.message, message.len);
+}
+
+/*
+ * Prints the Bluetooth link statistics and its recent transitions.
+ */
+static void link_dump(void) {
+    bt_ext_link_stats_t stats;
+    bt_ext_link_stats(&stats);
+
+    unsigned long now = timer_get_ticks();
+    printf("link: %s for %lu ms, %lu connects, %lu outages, up %lu ms in total\n",
+            stats.connected ? "up" : "down",
+            (now - stats.since_ticks) / TICKS_PER_USEC / 1000,
+            stats.connects, stats.outages, stats.uptime_ticks / TICKS_PER_USEC / 1000);
+
+    for (int i = 0; i < stats.nrecords; i++) {
+        printf("  %s %lu ms ago\n",
+                stats.log[i].event == BT_EXT_LINK_CONNECTED ? "connected" : "lost",
+                (now - stats.log[i].ticks) / TICKS_PER_USEC / 1000);
+    }
+}
+
+static bool command_ready(void *aux_data) {
+    return chess_has_command();
+}
+
+/*
+ * Handles a command from the host (see engine.py).
+ */
+static void handle_command(void *aux_data) {
+    char cmd[CHESS_LINE_LENGTH];
+    if (!chess_next_command(cmd, sizeof(cmd)))
+        return;
+
+    int len = strlen(cmd);
+    if (cmd[0] == 'S' && len <= 5) {
+        cmd[len - 1] = '\0';
+        // stats
+        switch (cmd[1]) {
+            case 'W':
+                chess_gui_stats(cmd + 2, NULL, NULL);
+                break;
+            case 'D':
+                chess_gui_stats(NULL, cmd + 2, NULL);
+                break;
+            case 'L':
+                chess_gui_stats(NULL, NULL, cmd + 2);
+                break;
+        }
+    } else if (cmd[0] == 'C' && cmd[1] == ' ') {
+        // the opponent's likely moves, after the engine's move (handled
+        // first, see main); dropped if the opponent has moved since
+        if (!module.pending && !module.cancelling)
+            set_candidates(cmd + 2);
+    } else if (cmd[0] == 'R' && cmd[1] == ' ') {
+        // the engine's reply to one of them, computed ahead
+        cmd[len - 1] = '\0';
+        if (!module.pending && !module.cancelling)
+            add_cached_reply(cmd + 2);
+    } else if (strcmp(cmd, "MATE\n") == 0) {
+        // the engine's reply: checkmate, it has no move
+        if (module.pending) {
+            module.pending = false;
+            evloop_cancel(module.timeout_task);
+            chess_gui_update(module.pending_move, false);
+            send_opp_move(module.pending_move);
+        }
+    } else if (cmd[0] == 'Q') {
+        // queue and link statistics, printed back to the host
+        ringq_dump();
+        evloop_dump();
+        link_dump();
+    }
 }
 
 int main(void) {
@@ -154,47 +864,38 @@ int main(void) {
     interrupts_global_enable();
     uart_init();
 
-    jnxu_init(BT_MODE, BT_MAC);
-    jnxu_register_handler(CMD_CURSOR, update_cursor, NULL);
-    jnxu_register_handler(CMD_PRESS, button_press, NULL);
-    jnxu_register_handler(CMD_RESET_MOVE, reset_move, NULL);
+    module.codebook = codebook_find(BRAIN_CODEBOOK);
+    movegen_init(&module.position);
+    module.in_sync = true;
+
+    hand_queue_init(&module.hand_messages);
+    hand_queue_register(&module.hand_messages, "brain.hand");
+
+    jnxu_init(transport_bt_init(BT_MODE, BT_MAC));
+    for (uintptr_t i = 0; i < sizeof(HAND_HANDLERS) / sizeof(*HAND_HANDLERS); i++)
+        jnxu_register_handler(HAND_HANDLERS[i].cmd, queue_hand_message, (void *)i);
 
     chess_gui_init();
-    reset_cursor();
+#if BRAIN_SNAP_CURSOR
+    move_entry_follow(&module.entry, &module.position, PLAYING);
+#endif
+    move_entry_reset(&module.entry);
     paint_cursor();
     chess_gui_sidebar();
     chess_init();
 
+    // the engine's move first, before the commands which follow it (of two
+    // tasks with the same deadline, the first one added runs first)
+    evloop_add("engine", reply_ready, handle_reply, NULL, BRAIN_ENGINE_BUDGET_USEC);
+    evloop_add("hand", hand_message_ready, handle_hand_message, NULL, BRAIN_HAND_BUDGET_USEC);
+    evloop_add("commands", command_ready, handle_command, NULL, BRAIN_COMMAND_BUDGET_USEC);
+    module.timeout_task = evloop_add_timer("engine timeout", engine_timeout, NULL,
+            BRAIN_ENGINE_BUDGET_USEC);
+
 #if PLAYING == WHITE
-    char your_move[8];
-    chess_get_move(your_move, sizeof(your_move));
-    chess_gui_update(your_move, true);
-    jnxu_send(CMD_MOVE, (const uint8_t *)your_move, 6);
+    // the engine's first move comes like any other reply
+    request_first_move();
 #endif
 
-    while (1) {
-        char *cmd = chess_next_command();
-        if (cmd != NULL) {
-            int len = strlen(cmd);
-            if (cmd[0] == 'S' && len <= 5) {
-                cmd[len - 1] = '\0';
-                // stats
-                switch (cmd[1]) {
-                    case 'W':
-                        chess_gui_stats(cmd + 2, NULL, NULL);
-                        break;
-                    case 'D':
-                        chess_gui_stats(NULL, cmd + 2, NULL);
-                        break;
-                    case 'L':
-                        chess_gui_stats(NULL, NULL, cmd + 2);
-                        break;
-                }
-            }
-
-            free(cmd);
-        } else {
-            timer_delay(1);
-        }
-    }
+    evloop_run();
 }
@@ -4,15 +4,18 @@
  * Author: Javier Garcia Nieto <jgnieto@stanford.edu>
  * Uart code adapted from provided uart.c module (by Julie Zelenski).
  */
+#include "alarm.h"
 #include "assert.h"
 #include "bt_ext.h"
 #include "ccu.h"
 #include "gpio.h"
 #include "gpio_extra.h"
 #include "interrupts.h"
-#include "ringbuffer.h"
+#include "irq.h"
+#include "ringq.h"
 #include "strings.h"
 #include "timer.h"
+#include "uart_regs.h"
 
 // #define BT_DEBUG 1
 
@@ -35,56 +38,43 @@
 
 #define ROLE_ENSURE_DELAY_MS 500
 
+#define UART_CLOCK_RATE         (24 * 1000 * 1000)
+#define UART_BAUD_MAX_ERROR_PCT 3
+#define BAUD_DEFAULT            9600
+#define BAUD_SWITCH_DELAY_MS    800 // module restarts after AT+RESET
+
 #define SIZE(x) ((sizeof(x)) / (sizeof(*x)))
 
-// structs defined to match layout of hardware registers
-typedef union {
-    struct {
-        union {
-            uint32_t rbr;   // receive buffer register
-            uint32_t thr;   // transmit holding register
-            uint32_t dll;   // divisor latch (LSB)
-        };
-        union {
-            uint32_t dlh;   // divisor latch (MSB)
-            uint32_t ier;   // interrupt enable register
-        };
-        union {
-            uint32_t iir;   // interrupt identification register
-            uint32_t fcr;   // FIFO control register
-        };
-        uint32_t lcr;       // line control register
-        uint32_t mcr;       // modem control register
-        uint32_t lsr;       // line status register
-        uint32_t reserved[25];
-        uint32_t usr;       // busy status, at offset 0x7c
-        uint32_t reserved2[9];
-        uint32_t halt;      // at offset 0xa4
-    } regs;
-    unsigned char padding[0x400];
-} uart_t;
-
-#define UART_BASE ((uart_t *)0x02500000)
-
-#define LCR_DLAB            (1 << 7)
-#define USR_BUSY            (1 << 0)
-#define USR_TX_NOT_FULL     (1 << 1)
-#define USR_TX_NOT_EMPTY    (1 << 2)
-#define USR_RX_NOT_EMPTY    (1 << 3)
+// incoming bytes waiting to be read (a bit over 80 ms worth at 115200 baud)
+#define RX_QUEUE_LENGTH 1024
+
+RINGQ_DECLARE(rx_queue, uint8_t, RX_QUEUE_LENGTH)
+
 
 static struct {
     volatile uart_t *uart;
 
     bt_ext_role_t role;
+    uint32_t baud;
     volatile bool connected;
     volatile bool was_ever_connected;
 
+    // OK+CONN was the last thing received, but it might still turn out to be
+    // OK+CONNA, OK+CONNE or OK+CONNF (see did_connect). If no byte follows
+    // within CONNECTED_MESSAGE_TIMEOUT_USEC, connect_alarm resolves it.
+    volatile bool connect_pending;
+    volatile unsigned long connect_pending_ticks;
+    alarm_t connect_alarm;
+
+    bt_ext_link_fn_t link_fn;
+    void *link_aux_data;
+
     volatile int bytes_since_last_trigger;
 
     bt_ext_role_t board_role; // role the board is set to currently
     bool role_is_set; // whether the role has been set or not
 
-    rb_t *rxbuf;
+    rx_queue_t rxbuf;
 
     bt_ext_fn_t trigger[256];
     bt_ext_fn_t fallback_trigger;
@@ -99,6 +89,16 @@ static struct {
     uint8_t buf[32];
 } ring;
 
+static struct {
+    unsigned long connects;
+    unsigned long outages;
+    unsigned long uptime_ticks;     // of the connections that already ended
+    unsigned long last_change_ticks;
+
+    int nrecords;   // total ever recorded, can be larger than the log
+    bt_ext_link_record_t log[BT_EXT_LINK_LOG_LEN];
+} link;
+
 /*
  * Returns true if the UART has a character to read.
  */
@@ -107,14 +107,12 @@ static bool haschar_uart(void) {
 }
 
 /*
- * Dequeues a byte from the ring buffer. Asserts buffer is not empty. Converts
- * the integer to a byte.
+ * Dequeues a byte from the ring buffer. Asserts buffer is not empty.
  */
 static uint8_t dequeue_byte(void) {
-    assert(!rb_empty(module.rxbuf));
-    int res_integer;
-    rb_dequeue(module.rxbuf, &res_integer);
-    uint8_t res = res_integer & 0xFF;
+    uint8_t res;
+    bool ok = rx_queue_dequeue(&module.rxbuf, &res);
+    assert(ok);
     return res;
 }
 
@@ -172,6 +170,50 @@ static bool did_connect(void) {
     return false;
 }
 
+/*
+ * Updates the state of the link. If it changed, records the transition in the
+ * log and calls the link handler. Called from the interrupt handler as well as
+ * from the main program, so it must not be interrupted halfway.
+ *
+ * @param connected whether the link is now up
+ * @param ticks     time at which the transition happened
+ */
+static void set_link(bool connected, unsigned long ticks) {
+    if (connected == module.connected)
+        return;
+
+    module.connected = connected;
+
+    if (connected) {
+        module.was_ever_connected = true;
+        link.connects++;
+    } else {
+        link.outages++;
+        link.uptime_ticks += ticks - link.last_change_ticks;
+    }
+    link.last_change_ticks = ticks;
+
+    bt_ext_link_record_t *record = &link.log[link.nrecords++ % BT_EXT_LINK_LOG_LEN];
+    record->event = connected ? BT_EXT_LINK_CONNECTED : BT_EXT_LINK_LOST;
+    record->ticks = ticks;
+
+    if (module.link_fn != NULL)
+        module.link_fn(record->event, ticks, module.link_aux_data);
+}
+
+/*
+ * Alarm function: nothing followed OK+CONN for CONNECTED_MESSAGE_TIMEOUT_USEC,
+ * so it really was a connection. Runs from the timer interrupt, which cannot
+ * be interrupted by the UART one halfway.
+ */
+static void resolve_connect(void *aux_data) {
+    if (!module.connect_pending)
+        return;
+
+    module.connect_pending = false;
+    set_link(true, module.connect_pending_ticks);
+}
+
 /*
  * Receives a byte from the UART and stores it in the ring buffer. If the
  * message is a connection message, sets the module's connected flag to true.
@@ -185,13 +227,23 @@ static uint8_t recv_uart(void) {
     // store the byte in the cache ring buffer
     ring.buf[ring.nbytes++ % sizeof(ring.buf)] = byte;
 
-    if (did_connect()) {
-        module.connected = true;
-        module.was_ever_connected = true;
+    // a pending OK+CONN is resolved by whichever byte comes next
+    bool was_pending = module.connect_pending;
+    module.connect_pending = false;
+    alarm_cancel(&module.connect_alarm);
+
+    if (was_pending && did_connect()) {
+        set_link(true, module.connect_pending_ticks);
 
     // else if lost connection
     } else if (ringstrcmp(ring.buf, sizeof(ring.buf), ring.nbytes, LOST_MESSAGE, sizeof(LOST_MESSAGE) - 1)) {
-        module.connected = false;
+        set_link(false, timer_get_ticks());
+
+    // else if it might be a connection, wait for the next byte to know
+    } else if (ringstrcmp(ring.buf, sizeof(ring.buf), ring.nbytes, CONNECTED_MESSAGE, sizeof(CONNECTED_MESSAGE) - 1)) {
+        module.connect_pending = true;
+        module.connect_pending_ticks = timer_get_ticks();
+        alarm_set(&module.connect_alarm, CONNECTED_MESSAGE_TIMEOUT_USEC, resolve_connect, NULL);
     }
 
 #if BT_DEBUG == 1
@@ -214,7 +266,7 @@ static void handle_interrupt(uintptr_t pc, void *data) {
         module.last_rx = timer_get_ticks();
 
         int byte_integer = 0xFF & byte;
-        rb_enqueue(module.rxbuf, byte);
+        rx_queue_enqueue(&module.rxbuf, byte);
 
         if (module.trigger[byte_integer] != NULL) {
             // trigger function available, call
@@ -231,10 +283,12 @@ static void handle_interrupt(uintptr_t pc, void *data) {
     }
 }
 
-// In case it's needed in the future.
-// static void flush_uart(void) {
-//     while ((module.uart->regs.usr & USR_BUSY) != 0) ;
-// }
+/*
+ * Waits until the UART is done transmitting everything in its FIFO.
+ */
+static void flush_uart(void) {
+    while ((module.uart->regs.usr & USR_BUSY) != 0) ;
+}
 
 void bt_ext_register_trigger(uint8_t byte, bt_ext_fn_t fn) {
     assert(module.trigger[byte] == NULL);
@@ -393,35 +447,208 @@ void bt_ext_connect(const bt_ext_role_t role, const char *mac) {
 }
 
 void bt_ext_force_set_connected(void) {
-    module.connected = true;
-    module.was_ever_connected = true;
+    unsigned long flags = irq_save();
+    set_link(true, timer_get_ticks());
+    irq_restore(flags);
 }
 
 int bt_ext_read(uint8_t *buf, size_t len) {
-    for (size_t i = 0; i < len - 1; i++) {
-        if (!bt_ext_has_data()) {
-            buf[i] = '\0';
-            return i;
-        }
-        buf[i] = dequeue_byte();
-    }
-    buf[len - 1] = '\0';
-    return len;
+    // leave space for the null-terminator
+    size_t n = rx_queue_dequeue_bulk(&module.rxbuf, buf, len - 1);
+    buf[n] = '\0';
+    return n;
 }
 
 bool bt_ext_has_data(void) {
-    return !rb_empty(module.rxbuf);
+    return !rx_queue_empty(&module.rxbuf);
 }
 
 bool bt_ext_connected(void) {
-    if (!module.connected &&
-            timer_get_ticks() - module.last_rx > CONNECTED_MESSAGE_TIMEOUT_USEC * TICKS_PER_USEC &&
-            ringstrcmp(ring.buf, sizeof(ring.buf), ring.nbytes, CONNECTED_MESSAGE, sizeof(CONNECTED_MESSAGE) - 1)) {
-        module.connected = true;
-        module.was_ever_connected = true;
+    // a pending OK+CONN is resolved by the next byte or by connect_alarm
+    return module.connected;
+}
+
+void bt_ext_register_link_handler(bt_ext_link_fn_t fn, void *aux_data) {
+    module.link_fn = fn;
+    module.link_aux_data = aux_data;
+}
+
+void bt_ext_link_stats(bt_ext_link_stats_t *stats) {
+    unsigned long flags = irq_save();
+
+    unsigned long now = timer_get_ticks();
+
+    stats->connected = module.connected;
+    stats->connects = link.connects;
+    stats->outages = link.outages;
+    stats->since_ticks = link.last_change_ticks;
+    stats->uptime_ticks = link.uptime_ticks;
+    if (module.connected)
+        stats->uptime_ticks += now - link.last_change_ticks;
+
+    // copy the log, oldest first
+    int first = link.nrecords > BT_EXT_LINK_LOG_LEN ? link.nrecords - BT_EXT_LINK_LOG_LEN : 0;
+    stats->nrecords = link.nrecords - first;
+    for (int i = 0; i < stats->nrecords; i++) {
+        stats->log[i] = link.log[(first + i) % BT_EXT_LINK_LOG_LEN];
     }
 
-    return module.connected;
+    irq_restore(flags);
+}
+
+/*
+ * Computes the UART divisor for the given baud rate, rounding to the nearest
+ * integer (truncating makes the error noticeably worse at high rates).
+ *
+ * @param clock_rate    rate of the clock feeding the UART, in Hz
+ * @param baud          desired baud rate
+ * @return              value to be written to DLL/DLH
+ */
+static uint32_t uart_divisor(uint32_t clock_rate, uint32_t baud) {
+    return (clock_rate + 8 * baud) / (16 * baud);
+}
+
+/*
+ * Checks whether the UART can generate the given baud rate within
+ * UART_BAUD_MAX_ERROR_PCT of the desired rate.
+ */
+static bool uart_baud_supported(uint32_t baud) {
+    uint32_t udiv = uart_divisor(UART_CLOCK_RATE, baud);
+    if (udiv == 0 || udiv > 0xffff)
+        return false;
+
+    uint32_t actual = UART_CLOCK_RATE / (16 * udiv);
+    uint32_t error = actual > baud ? actual - baud : baud - actual;
+    return error * 100 <= baud * UART_BAUD_MAX_ERROR_PCT;
+}
+
+/*
+ * Reprograms the divisor of the UART to the given baud rate. Waits for any
+ * pending transmission to finish, since changing the divisor mid-byte would
+ * corrupt it.
+ *
+ * @param baud  desired baud rate
+ * @return      `false` if the rate is not supported (in which case nothing is
+ *                  changed), `true` otherwise.
+ */
+static bool uart_set_baud(uint32_t baud) {
+    if (!uart_baud_supported(baud))
+        return false;
+
+    uint32_t udiv = uart_divisor(UART_CLOCK_RATE, baud);
+
+    flush_uart();
+
+    module.uart->regs.halt = 1;     // temporarily disable TX transfer
+    module.uart->regs.lcr |= LCR_DLAB;  // set DLAB = 1 to access DLL/DLH
+    module.uart->regs.dll = udiv & 0xff;        // low byte of divisor -> DLL
+    module.uart->regs.dlh = (udiv >> 8) & 0xff; // hi byte of divisor -> DLH
+    module.uart->regs.lcr &= ~LCR_DLAB; // set DLAB = 0 to access RBR/THR
+    module.uart->regs.halt = 0;     // re-enable TX transfer
+
+    module.baud = baud;
+    return true;
+}
+
+/*
+ * Baud rates supported by the module, indexed by the number used in the
+ * AT+BAUD command (i.e. AT+BAUD4 sets 115200).
+ */
+static const uint32_t BAUD_RATES[] = {
+    9600, 19200, 38400, 57600, 115200, 4800, 2400, 1200, 230400,
+};
+
+/*
+ * Order in which rates are tried when detecting the rate of the module. The
+ * factory default goes first, followed by the rates we are likely to have
+ * left the module in.
+ */
+static const uint32_t BAUD_DETECT_ORDER[] = {
+    BAUD_DEFAULT, BT_EXT_TARGET_BAUD, 57600, 38400, 19200, 230400, 4800, 2400, 1200,
+};
+
+/*
+ * Discards everything received so far. Used after changing baud rates, since
+ * anything received during the switch is garbage.
+ */
+static void discard_rx(void) {
+    while (bt_ext_has_data()) dequeue_byte();
+}
+
+/*
+ * Sends a single "AT" (no retries) at the current rate and checks whether the
+ * module understood it.
+ */
+static bool probe_baud(void) {
+    discard_rx();
+    bt_ext_send_raw_str("AT");
+    return wait_response(NULL, 0);
+}
+
+/*
+ * Tries every supported rate until the module answers. Leaves the UART at the
+ * detected rate or, if the module never answered, at BAUD_DEFAULT.
+ *
+ * @return  `true` if the module answered at some rate, `false` otherwise.
+ */
+static bool detect_baud(void) {
+    for (int i = 0; i < SIZE(BAUD_DETECT_ORDER); i++) {
+        if (uart_set_baud(BAUD_DETECT_ORDER[i]) && probe_baud())
+            return true;
+    }
+
+    uart_set_baud(BAUD_DEFAULT);
+    return false;
+}
+
+uint32_t bt_ext_get_baud(void) {
+    return module.baud;
+}
+
+bool bt_ext_set_baud(uint32_t baud) {
+    if (baud == module.baud)
+        return true;
+
+    // find the code for the AT+BAUD command
+    int code = -1;
+    for (int i = 0; i < SIZE(BAUD_RATES); i++) {
+        if (BAUD_RATES[i] == baud)
+            code = i;
+    }
+
+    // do not ask the module for a rate we cannot generate ourselves
+    if (code < 0 || !uart_baud_supported(baud))
+        return false;
+
+    char cmd[16] = "AT+BAUD";
+    char arg[] = { '0' + code, '\0' };
+    strlcat(cmd, arg, sizeof(cmd));
+
+    if (!bt_ext_send_cmd(cmd, NULL, 0))
+        return false;
+
+    // new rate only takes effect after the module restarts
+    bt_ext_send_cmd("AT+RESET", NULL, 0);
+
+    // the restart closes any open connection
+    unsigned long flags = irq_save();
+    module.connect_pending = false;
+    alarm_cancel(&module.connect_alarm);
+    set_link(false, timer_get_ticks());
+    irq_restore(flags);
+
+    timer_delay_ms(BAUD_SWITCH_DELAY_MS);
+
+    uart_set_baud(baud);
+    for (int i = 0; i < RETRIES; i++) {
+        if (probe_baud())
+            return true;
+    }
+
+    // The module is not answering at the new rate. Either it never switched
+    // or the link cannot sustain the rate, so find wherever it ended up.
+    detect_baud();
+    return module.baud == baud;
 }
 
 // modified from uart.c
@@ -440,18 +667,9 @@ static void setup_uart(void) {
     gpio_set_function(UART_RX, UART_FN);
     gpio_set_pullup(UART_RX);
 
-    // configure baud rate
-    uint32_t baud = 9600;
+    // configure baud rate (until we know the rate the module is at)
     module.uart->regs.fcr = 1;      // enable TX/RX fifo
-    module.uart->regs.halt = 1;     // temporarily disable TX transfer
-
-    uint32_t sys_clock_rate = 24 * 1000000;
-    uint32_t udiv = sys_clock_rate / (16 * baud);
-    module.uart->regs.lcr |= LCR_DLAB;  // set DLAB = 1 to access DLL/DLH
-    module.uart->regs.dll = udiv & 0xff;        // low byte of divisor -> DLL
-    module.uart->regs.dlh = (udiv >> 8) & 0xff; // hi byte of divisor -> DLH
-    module.uart->regs.lcr &= ~LCR_DLAB; // set DLAB = 0 to access RBR/THR
-    module.uart->regs.halt = 0;     // re-enable TX transfer
+    uart_set_baud(BAUD_DEFAULT);
 
     // configure data-parity-stop (low 4 bits of LCR)
     uint8_t data = 0b11;    // 8 data
@@ -480,7 +698,11 @@ void bt_ext_init(void) {
         "AT+NOTI1", // enable notifications (OK+CONN and OK+LOST)
     };
 
-    module.rxbuf = rb_new();
+    module.connect_alarm.pending = false;
+    alarm_init();
+
+    rx_queue_init(&module.rxbuf);
+    rx_queue_register(&module.rxbuf, "bt_ext.rx");
     setup_uart();
 
     // initialize the ring buffer and pretend we have received as many bytes as
@@ -490,8 +712,15 @@ void bt_ext_init(void) {
     // all '\0' characters.
     ring.nbytes = sizeof(ring.buf);
 
+    // the module remembers its rate across power cycles, so find it first
+    detect_baud();
+
     // send config commands.
     for (int i = 0; i < SIZE(CONFIG_COMMANDS); i++) {
         bt_ext_send_cmd(CONFIG_COMMANDS[i], NULL, 0);
     }
+
+    // Move to the faster rate. If it fails, we stay at whatever rate the module
+    // answered at, which is slower but works.
+    bt_ext_set_baud(BT_EXT_TARGET_BAUD);
 }
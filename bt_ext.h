@@ -15,6 +15,8 @@
  * The module is designed to be used in a non-blocking manner. The user should
  * first call bt_ext_init only once to set up the UART module send some initial
  * configuration commands to the Bluetooth module, and set up the module itself.
+ * bt_ext_init also detects the baud rate the module is at and, if possible,
+ * switches it to BT_EXT_TARGET_BAUD.
  * Then, the user should call bt_ext_connect to connect to the other device, as
  * many times as necessary until the connection succeeds. At any time, the user
  * can call bt_ext_has_data to check if there is data available to read from the
@@ -32,6 +34,13 @@
  * risk of the ringbuffer storing incoming data filling up, there also exists
  * a fallback trigger which will be called after BT_EXT_MAX_BYTES_NO_TRIGGER
  * is exceeded.
+ *
+ * LINK EVENTS:
+ * Instead of polling bt_ext_connected, the user can register a link handler,
+ * which is called (from the interrupt handler) as soon as the module reports
+ * that the connection was established or lost. Every transition is also kept
+ * in a small log, along with uptime and outage counters (see
+ * bt_ext_link_stats).
  */
 
 #include <stdbool.h>
@@ -40,6 +49,10 @@
 
 #define BT_EXT_MAX_BYTES_NO_TRIGGER 127
 
+// Rate the UART link to the module is switched to by bt_ext_init. The module
+// boots at whatever rate it was last set to, which is detected automatically.
+#define BT_EXT_TARGET_BAUD 115200
+
 typedef enum {
     BT_EXT_ROLE_SUBORDINATE = 0,    // BT docs: "slave"
     BT_EXT_ROLE_PRIMARY = 1,        // BT docs: "master"
@@ -47,11 +60,61 @@ typedef enum {
 
 typedef void (*bt_ext_fn_t)(void);
 
+#define BT_EXT_LINK_LOG_LEN 16
+
+typedef enum {
+    BT_EXT_LINK_CONNECTED = 0,
+    BT_EXT_LINK_LOST,
+} bt_ext_link_event_t;
+
+// Called when the state of the link changes. `ticks` is the time (as per
+// timer_get_ticks) at which the module reported the change.
+typedef void (*bt_ext_link_fn_t)(bt_ext_link_event_t event, unsigned long ticks, void *aux_data);
+
+typedef struct {
+    bt_ext_link_event_t event;
+    unsigned long ticks;
+} bt_ext_link_record_t;
+
+typedef struct {
+    bool connected;
+    unsigned long connects;         // number of times the link came up
+    unsigned long outages;          // number of times the link was lost
+    unsigned long uptime_ticks;     // total time connected, including now
+    unsigned long since_ticks;      // time of the last transition
+
+    int nrecords;                   // number of entries in log
+    bt_ext_link_record_t log[BT_EXT_LINK_LOG_LEN]; // last transitions, oldest first
+} bt_ext_link_stats_t;
+
 /*
  * `bt_ext_init` initializes the Bluetooth module.
  */
 void bt_ext_init(void);
 
+/*
+ * `bt_ext_set_baud` switches both the Bluetooth module and the UART connected
+ * to it to the given baud rate. The module only accepts the rates 1200, 2400,
+ * 4800, 9600, 19200, 38400, 57600, 115200 and 230400 (and the UART must be
+ * able to generate them accurately). Since the module restarts to apply the
+ * new rate, any open connection is closed.
+ *
+ * If the module does not answer at the new rate, the current rate of the
+ * module is detected again and used instead.
+ *
+ * @param baud  desired baud rate
+ * @return      `true` if the link is now at the given rate, `false` otherwise
+ *                  (use bt_ext_get_baud to find the rate in use).
+ */
+bool bt_ext_set_baud(uint32_t baud);
+
+/*
+ * `bt_ext_get_baud` returns the baud rate currently used to talk to the module.
+ *
+ * @return  baud rate in use
+ */
+uint32_t bt_ext_get_baud(void);
+
 /*
  * `bt_ext_send_cmd` sends an AT command to the Bluetooth module and waits for a
  * response. The response is stored in the `response` buffer. The `len`
@@ -120,12 +183,31 @@ bool bt_ext_has_data(void);
 
 /*
  * `bt_ext_connected` checks whether the module is connected to a Bluetooth
- * device.
+ * device. Cheap enough to be called before every send.
  * @return  `true` if the Bluetooth module is connected to a device, `false`
  *          otherwise.
  */
 bool bt_ext_connected(void);
 
+/*
+ * `bt_ext_register_link_handler` registers a function to be called whenever
+ * the link is established or lost. There is only one handler; registering a
+ * new one replaces the previous one. The handler is called from interrupt
+ * context, so it should be short.
+ *
+ * @param fn        function to be called on every transition (NULL to remove)
+ * @param aux_data  pointer passed to the handler as is
+ */
+void bt_ext_register_link_handler(bt_ext_link_fn_t fn, void *aux_data);
+
+/*
+ * `bt_ext_link_stats` copies the uptime/outage counters and the log of the
+ * last BT_EXT_LINK_LOG_LEN link transitions.
+ *
+ * @param stats     where to store the statistics
+ */
+void bt_ext_link_stats(bt_ext_link_stats_t *stats);
+
 /*
  * `bt_ext_register_trigger` registers a function to be called when the given
  * byte is received from the Bluetooth module.Asserts that the byte is not
@@ -0,0 +1,203 @@
+/*
+ * Buzz programs: compiler, validator and stepping (see buzz.h).
+ */
+#include "buzz.h"
+#include "codebook.h"
+
+// the header is the version, the table size and the table
+#define HEADER_LEN(program) (2 + (size_t)(program)[1])
+
+// longest pattern the compiler looks for when folding repeats
+#define MAX_UNIT 4
+
+// the codebook symbols compiled, in table order (index = symbol - 1)
+static const uint8_t TABLE_SYMBOLS[] = {
+    CODEBOOK_SHORT, CODEBOOK_MEDIUM, CODEBOOK_LONG, CODEBOOK_GAP, CODEBOOK_SEPARATOR,
+};
+
+#define TABLE_LEN (sizeof(TABLE_SYMBOLS) / sizeof(*TABLE_SYMBOLS))
+
+void buzz_cursor_init(buzz_cursor_t *cursor, const uint8_t *program, size_t len) {
+    cursor->program = program;
+    cursor->len = len;
+    cursor->pc = HEADER_LEN(program);
+    cursor->depth = 0;
+}
+
+bool buzz_cursor_next(buzz_cursor_t *cursor, bool *pulse, unsigned long *usec) {
+    const uint8_t *table = cursor->program + 2;
+
+    while (1) {
+        // end of a repeated body: go back, or leave it after the last time
+        while (cursor->depth > 0 && cursor->pc == cursor->stack[cursor->depth - 1].end) {
+            if (--cursor->stack[cursor->depth - 1].remaining > 0)
+                cursor->pc = cursor->stack[cursor->depth - 1].start;
+            else
+                cursor->depth--;
+        }
+
+        if (cursor->pc >= cursor->len)
+            return false;
+
+        uint8_t instruction = cursor->program[cursor->pc++];
+        uint8_t arg = instruction & BUZZ_ARG_MASK;
+
+        switch (instruction & BUZZ_OP_MASK) {
+            case BUZZ_OP_PULSE:
+            case BUZZ_OP_GAP:
+                *pulse = (instruction & BUZZ_OP_MASK) == BUZZ_OP_PULSE;
+                *usec = (unsigned long)table[arg] * BUZZ_TIME_UNIT_USEC;
+                return true;
+
+            case BUZZ_OP_REPEAT: {
+                size_t body = cursor->program[cursor->pc++];
+                cursor->stack[cursor->depth].start = cursor->pc;
+                cursor->stack[cursor->depth].end = cursor->pc + body;
+                cursor->stack[cursor->depth].remaining = arg;
+                cursor->depth++;
+                break;
+            }
+
+            default: // END
+                cursor->pc = cursor->len;
+                return false;
+        }
+    }
+}
+
+bool buzz_validate(const uint8_t *program, size_t len) {
+    if (len < 2 || program[0] != BUZZ_VERSION || program[1] > BUZZ_MAX_TABLE)
+        return false;
+    if (len < HEADER_LEN(program))
+        return false;
+
+    size_t ends[BUZZ_MAX_NESTING];
+    int depth = 0;
+    size_t pc = HEADER_LEN(program);
+
+    while (pc < len) {
+        uint8_t instruction = program[pc++];
+        uint8_t arg = instruction & BUZZ_ARG_MASK;
+
+        switch (instruction & BUZZ_OP_MASK) {
+            case BUZZ_OP_END:
+                // whatever follows is ignored, but a repeat must not be cut
+                return depth == 0;
+
+            case BUZZ_OP_PULSE:
+            case BUZZ_OP_GAP:
+                if (arg >= program[1])
+                    return false;
+                break;
+
+            case BUZZ_OP_REPEAT:
+                if (arg == 0 || pc >= len || depth == BUZZ_MAX_NESTING)
+                    return false;
+                size_t body = program[pc++];
+                if (body == 0 || pc + body > len)
+                    return false;
+                if (depth > 0 && pc + body > ends[depth - 1])
+                    return false;
+                ends[depth++] = pc + body;
+                break;
+
+            default:
+                return false;
+        }
+
+        // instructions must not straddle the end of a body
+        while (depth > 0 && pc >= ends[depth - 1]) {
+            if (pc > ends[depth - 1])
+                return false;
+            depth--;
+        }
+    }
+
+    return depth == 0;
+}
+
+unsigned long buzz_duration_usec(const uint8_t *program, size_t len) {
+    buzz_cursor_t cursor;
+    bool pulse;
+    unsigned long usec, total = 0;
+
+    buzz_cursor_init(&cursor, program, len);
+    while (buzz_cursor_next(&cursor, &pulse, &usec))
+        total += usec;
+
+    return total;
+}
+
+/*
+ * Number of times the `unit` instructions at ops[i] repeat back to back.
+ */
+static int repeats(const uint8_t *ops, size_t n, size_t i, size_t unit) {
+    int count = 1;
+
+    while (count < BUZZ_MAX_REPEAT && i + (count + 1) * unit <= n) {
+        for (size_t k = 0; k < unit; k++) {
+            if (ops[i + count * unit + k] != ops[i + k])
+                return count;
+        }
+        count++;
+    }
+
+    return count;
+}
+
+size_t buzz_compile(const uint8_t *symbols, size_t n, uint8_t *program, size_t max) {
+    uint8_t ops[CODEBOOK_MAX_SYMBOLS];
+    if (n > CODEBOOK_MAX_SYMBOLS)
+        return 0;
+
+    // one instruction per symbol, indexing the table below
+    for (size_t i = 0; i < n; i++) {
+        uint8_t op = codebook_symbol_is_buzz(symbols[i]) ? BUZZ_OP_PULSE : BUZZ_OP_GAP;
+        ops[i] = op | (symbols[i] - 1);
+    }
+
+    size_t len = 0;
+    if (max < 2 + TABLE_LEN)
+        return 0;
+
+    program[len++] = BUZZ_VERSION;
+    program[len++] = TABLE_LEN;
+    for (size_t i = 0; i < TABLE_LEN; i++)
+        program[len++] = codebook_symbol_usec(TABLE_SYMBOLS[i]) / BUZZ_TIME_UNIT_USEC;
+
+    // fold the pattern which saves the most bytes at each point, if any
+    for (size_t i = 0; i < n; ) {
+        size_t best_unit = 0;
+        int best_count = 1;
+        int best_saving = 0;
+
+        for (size_t unit = 1; unit <= MAX_UNIT && i + 2 * unit <= n; unit++) {
+            int count = repeats(ops, n, i, unit);
+            int saving = (count - 1) * unit - 2;
+            if (saving > best_saving) {
+                best_unit = unit;
+                best_count = count;
+                best_saving = saving;
+            }
+        }
+
+        size_t emit = best_unit ? best_unit : 1;
+        if (len + emit + (best_unit ? 2 : 0) > max)
+            return 0;
+
+        if (best_unit) {
+            program[len++] = BUZZ_OP_REPEAT | best_count;
+            program[len++] = best_unit;
+        }
+        for (size_t k = 0; k < emit; k++)
+            program[len++] = ops[i + k];
+
+        i += best_unit ? best_unit * best_count : 1;
+    }
+
+    if (len + 1 > max)
+        return 0;
+    program[len++] = BUZZ_OP_END;
+
+    return len;
+}
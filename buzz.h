@@ -0,0 +1,115 @@
+#ifndef BUZZ_H
+#define BUZZ_H
+
+/*
+ * Buzz programs: a compact bytecode describing a haptic pattern, compiled by
+ * the brain and played by the hand (see buzz_player.h), so that changing how
+ * moves are buzzed does not need the hand to be reflashed.
+ *
+ * Program Format
+ *
+ * A program starts with a header:
+ *  - BUZZ_VERSION
+ *  - n, the number of entries in the duration table (at most BUZZ_MAX_TABLE)
+ *  - n durations, in units of BUZZ_TIME_UNIT_USEC (so up to 2.55 seconds)
+ *
+ * followed by instructions, one byte each (plus one operand byte for REPEAT):
+ *
+ *      000 00000           END (also the end of the program)
+ *      001 iiiii           PULSE: buzz for the duration at index i
+ *      010 iiiii           GAP: stay still for the duration at index i
+ *      011 nnnnn  len      REPEAT: run the next `len` bytes n times
+ *
+ * Repeats may be nested up to BUZZ_MAX_NESTING deep. For example, three 250ms
+ * buzzes with 170ms gaps between them is
+ *
+ *      01 02 19 11   20 62 02 41 20   00
+ *
+ * that is, table { 250ms, 170ms }, PULSE 0, then twice { GAP 1, PULSE 0 }.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUZZ_VERSION 1
+
+#define BUZZ_TIME_UNIT_USEC (10 * 1000)
+
+#define BUZZ_MAX_TABLE      8
+#define BUZZ_MAX_NESTING    4
+#define BUZZ_MAX_REPEAT     31
+
+// plenty for any move (see buzz_compile), and fits in a JNXU message
+#define BUZZ_MAX_PROGRAM    128
+
+#define BUZZ_OP_MASK        0xe0
+#define BUZZ_ARG_MASK       0x1f
+
+#define BUZZ_OP_END         0x00
+#define BUZZ_OP_PULSE       0x20
+#define BUZZ_OP_GAP         0x40
+#define BUZZ_OP_REPEAT      0x60
+
+// steps through a program, following the repeats (see buzz_cursor_next)
+typedef struct {
+    const uint8_t *program;
+    size_t len;
+    size_t pc;
+    int depth;
+    struct {
+        size_t start;   // of the body
+        size_t end;
+        int remaining;
+    } stack[BUZZ_MAX_NESTING];
+} buzz_cursor_t;
+
+/*
+ * `buzz_cursor_init` starts stepping through a (valid) program.
+ */
+void buzz_cursor_init(buzz_cursor_t *cursor, const uint8_t *program, size_t len);
+
+/*
+ * `buzz_cursor_next` moves to the next step of the program which takes time
+ * (a PULSE or a GAP).
+ *
+ * @param cursor    the cursor
+ * @param pulse     set to `true` for a PULSE, `false` for a GAP
+ * @param usec      set to the duration of the step
+ * @return          `false` if the program is over
+ */
+bool buzz_cursor_next(buzz_cursor_t *cursor, bool *pulse, unsigned long *usec);
+
+/*
+ * `buzz_compile` compiles a sequence of codebook symbols (see codebook.h) into
+ * a program, folding repeated patterns into REPEAT instructions.
+ *
+ * @param symbols   the symbols
+ * @param n         how many
+ * @param program   where to write the program
+ * @param max       size of `program`
+ * @return          the length of the program, 0 if it does not fit
+ */
+size_t buzz_compile(const uint8_t *symbols, size_t n, uint8_t *program, size_t max);
+
+/*
+ * `buzz_validate` checks that a program (i.e. received from the other device)
+ * is well formed: known version, table indices in range, repeats within the
+ * program and not nested too deep.
+ *
+ * @param program   the program
+ * @param len       its length
+ * @return          `true` if it can be played
+ */
+bool buzz_validate(const uint8_t *program, size_t len);
+
+/*
+ * `buzz_duration_usec` adds up how long a (valid) program takes to play.
+ *
+ * @param program   the program
+ * @param len       its length
+ * @return          the duration, in microseconds
+ */
+unsigned long buzz_duration_usec(const uint8_t *program, size_t len);
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ * Buzz program player on top of the servo and an alarm (see buzz_player.h).
+ */
+#include "buzz_player.h"
+#include "alarm.h"
+#include "buzz.h"
+#include "irq.h"
+#include "ringq.h"
+#include "servo.h"
+#include "strings.h"
+#include "timer.h"
+
+// every queued program starts with its length and its tag
+#define HEADER_LEN 2
+
+RINGQ_DECLARE(program_queue, uint8_t, BUZZ_PLAYER_QUEUE_LENGTH)
+RINGQ_MPSC_DECLARE(report_queue, buzz_player_report_t, BUZZ_PLAYER_REPORT_LENGTH)
+
+static struct {
+    program_queue_t queue;  // written by the main program, read by the alarm
+    report_queue_t reports;
+
+    // the urgent program waiting, only touched with interrupts off
+    uint8_t urgent[BUZZ_MAX_PROGRAM];
+    size_t urgent_len;
+    uint8_t urgent_tag;
+    volatile bool urgent_pending;
+    volatile bool cut;      // stop the program playing at the end of its step
+
+    // only touched from the alarm (and with it masked)
+    uint8_t program[BUZZ_MAX_PROGRAM];
+    uint8_t tag;
+    buzz_cursor_t cursor;
+    volatile bool playing;
+    bool pulse;             // the step playing is a buzz
+    unsigned long deadline; // ticks, start of the next step
+    alarm_t alarm;
+} module;
+
+static void report(uint8_t tag, buzz_player_outcome_t outcome) {
+    buzz_player_report_t r = { tag, outcome };
+    report_queue_enqueue(&module.reports, r);
+}
+
+/*
+ * Drops every queued program. Interrupts must be off, so that the alarm does
+ * not read the queue meanwhile.
+ */
+static void flush_queue(void) {
+    uint8_t header[HEADER_LEN];
+    uint8_t program[BUZZ_MAX_PROGRAM];
+
+    while (program_queue_dequeue_bulk(&module.queue, header, HEADER_LEN) == HEADER_LEN) {
+        program_queue_dequeue_bulk(&module.queue, program, header[0]);
+        report(header[1], BUZZ_PLAYER_DROPPED);
+    }
+}
+
+/*
+ * Moves the next program to module.program, the urgent one first. If nothing
+ * was playing, the timeline starts now.
+ */
+static bool load_next(void) {
+    size_t len;
+
+    if (module.urgent_pending) {
+        len = module.urgent_len;
+        memcpy(module.program, module.urgent, len);
+        module.tag = module.urgent_tag;
+        module.urgent_pending = false;
+    } else {
+        uint8_t header[HEADER_LEN];
+        if (program_queue_dequeue_bulk(&module.queue, header, HEADER_LEN) != HEADER_LEN)
+            return false;
+
+        len = header[0];
+        module.tag = header[1];
+        program_queue_dequeue_bulk(&module.queue, module.program, len);
+    }
+
+    buzz_cursor_init(&module.cursor, module.program, len);
+
+    if (!module.playing)
+        module.deadline = timer_get_ticks();
+    module.playing = true;
+
+    return true;
+}
+
+/*
+ * Alarm function: starts the next step of the timeline and sets the alarm for
+ * the one after.
+ */
+static void step(void *aux_data) {
+    unsigned long usec;
+
+    if (module.cut) {
+        module.cut = false;
+        if (module.playing) {
+            // if it was in its last step, it was delivered after all
+            buzz_cursor_t rest = module.cursor;
+            bool pulse;
+            bool more = buzz_cursor_next(&rest, &pulse, &usec);
+            report(module.tag, more ? BUZZ_PLAYER_CUT : BUZZ_PLAYER_DELIVERED);
+            module.playing = false;
+
+            // a pause before the urgent program, so it is not mistaken for
+            // the rest of the one cut
+            if (module.urgent_pending) {
+                servo_pause(BUZZ_PLAYER_BREAK_USEC);
+                module.pulse = false;
+                module.deadline += BUZZ_PLAYER_BREAK_USEC * TICKS_PER_USEC;
+                alarm_set_at(&module.alarm, module.deadline, step, NULL);
+                return;
+            }
+        }
+    }
+
+    while (!module.playing || !buzz_cursor_next(&module.cursor, &module.pulse, &usec)) {
+        if (module.playing)
+            report(module.tag, BUZZ_PLAYER_DELIVERED);
+
+        if (!load_next()) {
+            module.playing = false;
+            servo_stop();
+            return;
+        }
+    }
+
+    if (module.pulse)
+        servo_buzz(usec);
+    else
+        servo_pause(usec);
+
+    module.deadline += usec * TICKS_PER_USEC;
+    alarm_set_at(&module.alarm, module.deadline, step, NULL);
+}
+
+/*
+ * Cuts the program playing, if any: at the end of a buzz, or right away in a
+ * pause. Interrupts must be off.
+ */
+static void preempt(void) {
+    if (!module.playing)
+        return;
+
+    module.cut = true;
+    if (!module.pulse) {
+        module.deadline = timer_get_ticks();
+        alarm_set_at(&module.alarm, module.deadline, step, NULL);
+    }
+}
+
+void buzz_player_init(void) {
+    program_queue_init(&module.queue);
+    program_queue_register(&module.queue, "buzz.programs");
+    report_queue_init(&module.reports);
+    report_queue_register(&module.reports, "buzz.reports");
+
+    module.playing = false;
+    module.urgent_pending = false;
+    module.cut = false;
+    module.alarm.pending = false;
+    alarm_init();
+}
+
+bool buzz_player_enqueue(const uint8_t *program, size_t len, buzz_player_priority_t priority,
+        uint8_t tag) {
+    if (len > BUZZ_MAX_PROGRAM || !buzz_validate(program, len)) {
+        report(tag, BUZZ_PLAYER_REJECTED);
+        return false;
+    }
+
+    unsigned long flags;
+
+    if (priority == BUZZ_PLAYER_URGENT) {
+        flags = irq_save();
+
+        if (module.urgent_pending)
+            report(module.urgent_tag, BUZZ_PLAYER_DROPPED);
+        memcpy(module.urgent, program, len);
+        module.urgent_len = len;
+        module.urgent_tag = tag;
+        module.urgent_pending = true;
+
+        flush_queue();
+        preempt();
+
+        irq_restore(flags);
+    } else {
+        if (BUZZ_PLAYER_QUEUE_LENGTH - program_queue_count(&module.queue) < len + HEADER_LEN) {
+            report(tag, BUZZ_PLAYER_REJECTED);
+            return false;
+        }
+
+        // header and program published at once, so the alarm never sees half
+        uint8_t entry[HEADER_LEN + BUZZ_MAX_PROGRAM];
+        entry[0] = len;
+        entry[1] = tag;
+        memcpy(entry + HEADER_LEN, program, len);
+        program_queue_enqueue_bulk(&module.queue, entry, len + HEADER_LEN);
+    }
+
+    // start the timeline if it is stopped
+    flags = irq_save();
+    if (!module.playing && !alarm_pending(&module.alarm))
+        alarm_set(&module.alarm, 0, step, NULL);
+    irq_restore(flags);
+
+    return true;
+}
+
+void buzz_player_cancel(void) {
+    unsigned long flags = irq_save();
+
+    if (module.urgent_pending)
+        report(module.urgent_tag, BUZZ_PLAYER_DROPPED);
+    module.urgent_pending = false;
+
+    flush_queue();
+    preempt();
+
+    irq_restore(flags);
+}
+
+bool buzz_player_busy(void) {
+    return module.playing || module.urgent_pending || !program_queue_empty(&module.queue);
+}
+
+bool buzz_player_next_report(buzz_player_report_t *out) {
+    return report_queue_dequeue(&module.reports, out);
+}
+
+bool buzz_player_has_report(void) {
+    return !report_queue_empty(&module.reports);
+}
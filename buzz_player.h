@@ -0,0 +1,106 @@
+#ifndef BUZZ_PLAYER_H
+#define BUZZ_PLAYER_H
+
+/*
+ * Plays buzz programs (see buzz.h) on the servo (see servo.h), one after the
+ * other.
+ *
+ * Every step of a program starts at an absolute time on a timeline (the start
+ * of the previous step plus its duration), run from an alarm (see alarm.h).
+ * So the timing is the same no matter how busy the main loop is, and errors do
+ * not add up over a long program. Programs queued while another one is playing
+ * continue the same timeline.
+ *
+ * An urgent program (say, "that move was invalid") does not wait behind what
+ * is queued: the queue is flushed, and the program playing is cut at the end
+ * of the step it is in (right away if it is in a pause), followed by a pause of
+ * BUZZ_PLAYER_BREAK_USEC so the wearer notices the interruption. Then the
+ * urgent program plays. A newer urgent program replaces one still waiting.
+ *
+ * Every program is given a tag when queued, and what became of it is reported
+ * (see buzz_player_next_report): played to the end, cut, flushed before it
+ * started, or rejected.
+ *
+ * NOTE: Remember to call interrupts_init and interrupts_global_enable!
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// bytes of programs waiting to be played (each with a 2 byte header)
+#define BUZZ_PLAYER_QUEUE_LENGTH 1024
+
+// reports waiting to be read
+#define BUZZ_PLAYER_REPORT_LENGTH 16
+
+// pause between a program that is cut and the urgent one
+#define BUZZ_PLAYER_BREAK_USEC (1000 * 1000)
+
+typedef enum {
+    BUZZ_PLAYER_NORMAL = 0,
+    BUZZ_PLAYER_URGENT,
+} buzz_player_priority_t;
+
+typedef enum {
+    BUZZ_PLAYER_DELIVERED = 0,  // played to the end
+    BUZZ_PLAYER_CUT,            // started, but preempted or cancelled
+    BUZZ_PLAYER_DROPPED,        // flushed before it started
+    BUZZ_PLAYER_REJECTED,       // not valid, or no room for it
+} buzz_player_outcome_t;
+
+typedef struct {
+    uint8_t tag;
+    uint8_t outcome;    // buzz_player_outcome_t
+} buzz_player_report_t;
+
+/*
+ * `buzz_player_init` sets up the player. The servo must already be set up with
+ * servo_init.
+ */
+void buzz_player_init(void);
+
+/*
+ * `buzz_player_enqueue` queues a program. The program is copied.
+ *
+ * @param program   the program
+ * @param len       its length
+ * @param priority  BUZZ_PLAYER_NORMAL to play after the ones already queued,
+ *                      BUZZ_PLAYER_URGENT to preempt them (see above)
+ * @param tag       identifies the program in its report
+ * @return          `false` if the program is not valid (see buzz_validate),
+ *                      or there is no room for it
+ */
+bool buzz_player_enqueue(const uint8_t *program, size_t len, buzz_player_priority_t priority,
+        uint8_t tag);
+
+/*
+ * `buzz_player_cancel` flushes the queue and stops the program playing at the
+ * end of the step it is in.
+ */
+void buzz_player_cancel(void);
+
+/*
+ * `buzz_player_busy` checks whether a program is playing or queued.
+ *
+ * @return          `true` if there is something left to play
+ */
+bool buzz_player_busy(void);
+
+/*
+ * `buzz_player_next_report` gets what became of a program, in the order it
+ * happened. Does not block.
+ *
+ * @param report    where to store it
+ * @return          `false` if there is none
+ */
+bool buzz_player_next_report(buzz_player_report_t *report);
+
+/*
+ * `buzz_player_has_report` checks whether there is a report to read.
+ *
+ * @return          `true` if buzz_player_next_report has one
+ */
+bool buzz_player_has_report(void);
+
+#endif
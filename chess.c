@@ -2,65 +2,133 @@
  * Module for communicating to Stockfish `engine.py` via UART.
  *
  * See `engine.py` for details on how the protocol works.
+ *
+ * Incoming bytes are received by an interrupt handler, which frames them into
+ * lines directly inside the slots of two queues: one for moves and one for
+ * commands (lines starting with '/'). Nothing is allocated and nothing waits
+ * for the user, so commands are received even while nobody asks for a move.
  * 
  * Author: Ellen Xu <ellenjxu@stanford.edu>
  */
 
 #include "assert.h"
 #include "chess.h"
+#include "interrupts.h"
 #include "uart.h"
 #include "printf.h"
-#include "malloc.h"
 #include "strings.h"
-#include "ringbuffer_ptr.h"
+#include "ringq.h"
+#include "uart_regs.h"
 #include "chess_commands.h"
 #include <stdint.h>
 
-static rb_ptr_t *rb;
+#define CONSOLE_UART_INDEX 0
 
-void chess_get_move(char buf[], size_t bufsize) {
-    assert(bufsize >= 8);
+// lines of each kind (moves, commands) waiting to be read
+#define LINE_QUEUE_LENGTH 16
 
-    // When we receive information from the host laptop, there is a chance that
-    // it might be a command, in which case we enqueue it and jump back to the
-    // top of the function.
-    char move[256];
+typedef struct {
+    char text[CHESS_LINE_LENGTH];
+} line_t;
 
-    int i = 0;
-    char ch;
+RINGQ_DECLARE(line_queue, line_t, LINE_QUEUE_LENGTH)
 
-was_command:
-    do {
-        ch = uart_getchar();
-        move[i++] = ch;
+static struct {
+    volatile uart_t *uart;
 
-        if (i >= 7 && move[0] != '/')   // if not command and too long, break
-            break;
-        else if (i >= sizeof(move) - 1) // if command and too long for command
-            break;
+    line_queue_t moves;
+    line_queue_t commands;
 
-    } while (ch != '\n' && ch != '\0');
+    // line being received, NULL if none or if it is being discarded
+    line_t *line;
+    line_queue_t *line_queue;
+    int line_len;
+    bool discarding; // no slot was free, drop bytes until the end of the line
+} module;
 
-    move[i] = '\0';
+/*
+ * Handles one byte of the line being received. The first byte decides the
+ * queue, the slot is claimed there and filled in place, and it is published
+ * once the newline arrives.
+ */
+static void frame_byte(char ch) {
+    bool end = (ch == '\n' || ch == '\0');
 
-    if (move[0] == '/') {   // found command
-        char *cmd = malloc(i);
-        memcpy(cmd, move + 1, i);
-        rb_ptr_enqueue(rb, (uintptr_t)cmd);
+    if (module.line == NULL && !module.discarding) {
+        if (end) return; // empty line
+
+        // start of a line: commands start with '/', anything else is a move
+        module.line_queue = (ch == '/') ? &module.commands : &module.moves;
+        module.line = line_queue_claim(module.line_queue);
+        module.line_len = 0;
+        module.discarding = (module.line == NULL);
+    }
+
+    if (module.discarding) {
+        if (end) module.discarding = false;
+        return;
+    }
 
-        // caller is expecting a move, so we jump back and see if we get one
-        i = 0;
-        goto was_command;
-    } else {
-        // copy the move to buffer
-        memcpy(buf, move, bufsize);
+    // keep the newline (moves are handled as "e2e4\n"), truncate if too long
+    if (module.line_len < CHESS_LINE_LENGTH - 2 || end) {
+        module.line->text[module.line_len++] = end ? '\n' : ch;
     }
+
+    if (end) {
+        module.line->text[module.line_len] = '\0';
+        line_queue_publish(module.line_queue);
+        module.line = NULL;
+    }
+}
+
+static void handle_interrupt(uintptr_t pc, void *data) {
+    while (module.uart->regs.usr & USR_RX_NOT_EMPTY) {
+        frame_byte(module.uart->regs.rbr & 0xFF);
+    }
+}
+
+/*
+ * Takes over receiving on the console UART (already set up by uart_init):
+ * interrupt on every byte received. Transmitting is still done by uart.h.
+ */
+static void setup_uart_rx(void) {
+    module.uart = UART_BASE + CONSOLE_UART_INDEX;
+
+    interrupt_source_t src = INTERRUPT_SOURCE_UART0 + CONSOLE_UART_INDEX;
+    interrupts_register_handler(src, handle_interrupt, NULL);
+    interrupts_enable_source(src);
+    module.uart->regs.ier |= IER_RX_AVAILABLE;
 }
 
-char *chess_next_command(void) {
-    uintptr_t ptr = 0;
-    rb_ptr_dequeue(rb, &ptr);
-    return (char *)ptr;
+bool chess_poll_move(char buf[], size_t bufsize) {
+    assert(bufsize >= 8);
+
+    line_t line;
+    if (!line_queue_dequeue(&module.moves, &line))
+        return false;
+
+    memcpy(buf, line.text, bufsize < sizeof(line.text) ? bufsize : sizeof(line.text));
+    buf[bufsize - 1] = '\0';
+    return true;
+}
+
+void chess_get_move(char buf[], size_t bufsize) {
+    while (!chess_poll_move(buf, bufsize)) ;
+}
+
+bool chess_next_command(char buf[], size_t bufsize) {
+    line_t line;
+    if (!line_queue_dequeue(&module.commands, &line))
+        return false;
+
+    // skip the '/'
+    buf[0] = '\0';
+    strlcat(buf, line.text + 1, bufsize);
+    return true;
+}
+
+bool chess_has_command(void) {
+    return !line_queue_empty(&module.commands);
 }
 
 void chess_send_move(const char* move) {
@@ -68,8 +136,20 @@ void chess_send_move(const char* move) {
     uart_putstring(move);
 }
 
+void chess_cancel_move(void) {
+    uart_putstring("\nCANCEL\n");
+}
+
+bool chess_has_move(void) {
+    return !line_queue_empty(&module.moves);
+}
+
 void chess_init(void) {
-    rb = rb_ptr_new();
+    line_queue_init(&module.moves);
+    line_queue_register(&module.moves, "chess.moves");
+    line_queue_init(&module.commands);
+    line_queue_register(&module.commands, "chess.commands");
+    setup_uart_rx();
 
 #if PLAYING == WHITE
     uart_putstring("\nGAME_WHITE\n");
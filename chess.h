@@ -11,10 +11,30 @@
  * Author: Javier Garcia Nieto <jgnieto@stanford.edu>
  */
 
+#include <stdbool.h>
 #include <stddef.h>
 
+// longest line received from the host, including newline and null-terminator
+// (longer lines are truncated)
+#define CHESS_LINE_LENGTH 160
+
+/*
+ * `chess_poll_move` gets the move that the Stockfish engine has calculated, if
+ * it has arrived. Does not block.
+ *
+ * May also be used to receive general messages from Stockfish.
+ *
+ * @param buf   pointer to an array of characters to store the message.
+ * @param size  size of buf in bytes.
+ * @return      `true` if a message was stored in buf, `false` if there is none
+ *
+ * NOTE: function ASSERTS that size >= 8.
+ */
+bool chess_poll_move(char buf[], size_t size);
+
 /*
- * `chess_get_move` gets the move that the Stockfish engine has calculated.
+ * `chess_get_move` gets the move that the Stockfish engine has calculated,
+ * blocking until it arrives.
  *
  * May also be used to receive general messages from Stockfish.
  *
@@ -34,17 +54,45 @@ void chess_get_move(char buf[], size_t size);
  */
 void chess_send_move(const char *move);
 
+/*
+ * `chess_cancel_move` asks the Stockfish engine to take back the last move sent
+ * with chess_send_move, and its reply to it if it already sent one. The engine
+ * then answers CANCELLED (read like a move, see chess_poll_move), after
+ * which it is waiting for a move again.
+ */
+void chess_cancel_move(void);
+
+/*
+ * `chess_has_move` checks whether a move (or any other message which is not a
+ * command) has arrived, to be read with chess_poll_move. Does not block.
+ *
+ * @return      `true` if there is one
+ */
+bool chess_has_move(void);
+
 /*
  * `chess_init` initializes the UART communication with the Stockfish engine.
+ * From then on, everything received from the host is handled by an interrupt,
+ * so interrupts must be enabled.
  */
 void chess_init(void);
 
 /*
- * `chess_next_command` returns the next command from the Stockfish engine.
+ * `chess_next_command` gets the next command from the Stockfish engine (without
+ * the leading '/', but with the newline). Does not block.
+ *
+ * @param buf   pointer to an array of characters to store the command.
+ * @param size  size of buf in bytes (CHESS_LINE_LENGTH fits any command).
+ * @return      `true` if a command was stored in buf, `false` if there is none
+ */
+bool chess_next_command(char buf[], size_t size);
+
+/*
+ * `chess_has_command` checks whether a command is waiting to be read with
+ * chess_next_command. Does not block.
  *
- * @return  pointer to the next command from the Stockfish engine. Caller is
- *          responsible for freeing the memory. NULL if no command available.
+ * @return      `true` if there is a command
  */
-char *chess_next_command(void);
+bool chess_has_command(void);
 
 #endif
@@ -9,9 +9,49 @@
 #define MOTION_CW   '+'
 #define MOTION_CCW  '-'
 
+// payload: [MOTION_CW | MOTION_CCW, number of squares (optional, default 1)]
 #define CMD_CURSOR      1
 #define CMD_PRESS       2
 #define CMD_RESET_MOVE  3
+// confirm the whole square under the cursor (and at the destination, submit
+// the move without promotion)
+#define CMD_CONFIRM     4
+// same payload as CMD_CURSOR, moves the cursor along the other axis
+#define CMD_CURSOR_ALT  5
+// a buzz program (see buzz.h) for the hand to play, payload [tag, program]
+// (see CMD_DELIVERY)
+#define CMD_BUZZ        6
+// a move as its index among the legal moves of the position both devices keep
+// track of (see movegen.h), payload [index, number of legal moves, UCI move];
+// the last two let the hand notice that its position is out of sync, and
+// still buzz the move the old way. CMD_MOVE_INDEX, which is buzzed, starts
+// with a tag too (see CMD_DELIVERY).
+#define CMD_MOVE_INDEX  7   // the wearer's move, to buzz
+#define CMD_MOVE_PLAYED 8   // the opponent's move, only to keep track
+// a move entered on the hand (see move_entry.h), payload the UCI move
+#define CMD_SUBMIT      9
+// where the cursor of the hand's move entry is, only for the screen, payload
+// [state, x, y, promotion + 1, from x, from y, candidate]
+#define CMD_CURSOR_STATE 10
+// a buzz program to play right away, cutting whatever the hand is playing and
+// dropping what it has queued (see buzz_player.h), payload as CMD_BUZZ
+#define CMD_BUZZ_URGENT 11
+// from the hand: what became of the messages it was asked to buzz, payload
+// pairs of [tag, outcome] (see buzz_player.h). The tag is the first byte of the
+// CMD_BUZZ, CMD_BUZZ_URGENT or CMD_MOVE_INDEX message, chosen by the brain
+// (so that a message lost on the way does not shift the others). Plain
+// CMD_MOVE messages have no tag and are reported with tag 0.
+#define CMD_DELIVERY    12
+// the opponent's likely moves, offered first when entering their move (see
+// move_entry_candidates), payload [number of legal moves, index...] with
+// indexes as in CMD_MOVE_INDEX, the most likely first
+#define CMD_CANDIDATES  13
+// takes back the last moves sent with CMD_MOVE_INDEX and CMD_MOVE_PLAYED (a
+// reply played before the engine confirmed it, which it did not), payload
+// [number of moves, number of legal moves after taking them back]; the hand
+// only remembers the positions before the last CMD_TAKEBACK_MAX moves
+#define CMD_TAKEBACK    14
+#define CMD_TAKEBACK_MAX 2
 
 #define CMD_MOVE        255
 
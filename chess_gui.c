@@ -113,6 +113,11 @@ static struct {
     char W[6];
     char D[6];
     char L[6];
+
+    char candidates[CHESS_GUI_MAX_CANDIDATES][6];
+    int ncandidates;
+    int candidate_cursor;
+    bool promoting;     // the promotion menu is where the candidates go
 } sidebar;
 
 static bool is_white(chess_gui_piece_t piece) {
@@ -277,6 +282,22 @@ static void draw_stat(const char *label, char *number, int line) {
 }
 #endif
 
+/*
+ * Draws the opponent's likely moves where the promotion menu goes (they are
+ * never shown at the same time), and "Other" after them.
+ */
+static void draw_candidates(void) {
+    int char_h = gl_get_char_height();
+
+    for (int i = 0; i <= sidebar.ncandidates; i++) {
+        gl_draw_string(
+                SQUARE_SIZE * 8 + 5,
+                SQUARE_SIZE * 6 + (char_h + 5) * (i + 1),
+                i < sidebar.ncandidates ? sidebar.candidates[i] : "Other",
+                sidebar.candidate_cursor == i ? GL_RED : SIDEBAR_FT);
+    }
+}
+
 static void sidebar_draw(void) {
     static const char *HEADERS[] = {
         "Mango Chess",
@@ -374,6 +395,8 @@ static void sidebar_draw(void) {
         if (i%2 == 1) line++;
     }
 
+    if (sidebar.ncandidates > 0 && !sidebar.promoting)
+        draw_candidates();
 }
 
 void chess_gui_sidebar(void) {
@@ -407,6 +430,30 @@ void chess_gui_stats(char *W, char *D, char *L) {
     chess_gui_sidebar();
 }
 
+void chess_gui_candidates(const char *const *moves, int count) {
+    if (count > CHESS_GUI_MAX_CANDIDATES)
+        count = CHESS_GUI_MAX_CANDIDATES;
+
+    for (int i = 0; i < count; i++) {
+        sidebar.candidates[i][0] = '\0';
+        strlcat(sidebar.candidates[i], moves[i], sizeof(sidebar.candidates[i]));
+    }
+    sidebar.ncandidates = count;
+    sidebar.candidate_cursor = -1;
+
+    chess_gui_sidebar();
+}
+
+void chess_gui_candidate_cursor(int cursor) {
+    if (sidebar.ncandidates == 0 || sidebar.promoting || cursor == sidebar.candidate_cursor)
+        return;
+
+    sidebar.candidate_cursor = cursor;
+    draw_candidates();
+    gl_swap_buffer();
+    draw_candidates();
+}
+
 static void draw_promote(int cursor) {
     static const char *PROMOTION_PIECES[] = {
         "Rook",
@@ -428,10 +475,17 @@ static void draw_promote(int cursor) {
 
 void chess_gui_promote(int cursor) {
     if (0 <= cursor && cursor <= 3) {
+        if (!sidebar.promoting && sidebar.ncandidates > 0) {
+            // hide the candidates first
+            sidebar.promoting = true;
+            chess_gui_sidebar();
+        }
+        sidebar.promoting = true;
         draw_promote(cursor);
         gl_swap_buffer();
         draw_promote(cursor);
     } else {
+        sidebar.promoting = false;
         chess_gui_sidebar();
     }
 }
@@ -469,7 +523,10 @@ static void reset_cursor(void) {
 #endif
 }
 
-void chess_gui_update(const char *move, bool engine) {
+/*
+ * Plays a move on the board and the list of taken pieces, without drawing.
+ */
+static void apply_move(const char *move) {
     // UCI format: e2e4\n
     int col1 = move[0] - 'a';
     int col2 = move[2] - 'a';
@@ -540,12 +597,38 @@ void chess_gui_update(const char *move, bool engine) {
     }
 
     board[row1][col1] = XX;
+}
+
+void chess_gui_update(const char *move, bool engine) {
+    apply_move(move);
 
+    // in the same coordinates as apply_move
     engine_move.display  = engine;
-    engine_move.from_col = col1;
-    engine_move.from_row = row1;
-    engine_move.to_col   = col2;
-    engine_move.to_row   = row2;
+    engine_move.from_col = move[0] - 'a';
+    engine_move.from_row = CHESS_SIZE - (move[1] - '1') - 1;
+    engine_move.to_col   = move[2] - 'a';
+    engine_move.to_row   = CHESS_SIZE - (move[3] - '1') - 1;
+
+    stale_everything();
+    reset_cursor();
+    chess_gui_draw();
+    chess_gui_sidebar();
+}
+
+void chess_gui_takeback(int n) {
+    int remaining = n < nmoves ? nmoves - n : 0;
+
+    // replay the game up to there
+    memcpy(board, STARTING_BOARD, sizeof(STARTING_BOARD));
+    sidebar.taken_count = 0;
+    nmoves = 0;
+    for (int i = 0; i < remaining; i++) {
+        char move[6];
+        memcpy(move, move_history[i], sizeof(move));
+        apply_move(move);
+    }
+
+    engine_move.display = false;
 
     stale_everything();
     reset_cursor();
@@ -571,6 +654,8 @@ void chess_gui_init(void) {
     sidebar.W[0] = sidebar.D[0] = sidebar.L[0] = '*';
     sidebar.W[1] = sidebar.D[1] = sidebar.L[1] = '*';
     sidebar.W[2] = sidebar.D[2] = sidebar.L[2] = '\0';
+    sidebar.ncandidates = 0;
+    sidebar.promoting = false;
 
     nmoves = 0;
 
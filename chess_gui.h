@@ -5,6 +5,9 @@
 #define CHESS_SIZE 8
 #endif
 
+// likely moves listed in the sidebar at most
+#define CHESS_GUI_MAX_CANDIDATES 8
+
 /*
  * Module for chess GUI. Displays a chess board on the screen. Includes
  * function to update UI based on new move.
@@ -59,6 +62,13 @@ void chess_gui_draw_cursor(int x, int y, bool is_piece_moved);
  */
 void chess_gui_update(const char *move, bool engine);
 
+/*
+ * `chess_gui_takeback` takes back the last moves passed to chess_gui_update.
+ *
+ * @param n         how many
+ */
+void chess_gui_takeback(int n);
+
 /*
  * `chess_gui_print` prints the current board state to the console.
  */
@@ -91,6 +101,23 @@ void chess_gui_stats(char *W, char *D, char *L);
  */
 void chess_gui_promote(int cursor);
 
+/*
+ * `chess_gui_candidates` lists the opponent's likely moves in the sidebar, to
+ * choose from with chess_gui_candidate_cursor. The list stays until it is
+ * replaced.
+ *
+ * @param moves     the moves, in UCI format without newline
+ * @param count     how many (0 to remove the list)
+ */
+void chess_gui_candidates(const char *const *moves, int count);
+
+/*
+ * `chess_gui_candidate_cursor` highlights one of the likely moves listed.
+ *
+ * @param cursor    its index, the number of moves for "Other", -1 for none
+ */
+void chess_gui_candidate_cursor(int cursor);
+
 /*
  * `chess_gui_sidebar` draws the sidebar on the screen.
  */
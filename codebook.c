@@ -0,0 +1,305 @@
+/*
+ * Haptic codebooks (see codebook.h).
+ */
+#include "codebook.h"
+#include "chess_commands.h"
+#include "strings.h"
+
+// the prefix code encodes four fields, the deltas having 15 possible values
+#define PREFIX_FIELDS 4
+#define PREFIX_MAX_VALUES 15
+
+/*
+ * How often each value of each field of the prefix code appears, from the
+ * wearer's side. Only the ratios matter. `./codebook_bench -w` prints these
+ * tables measured on a corpus of games, to paste here.
+ */
+static const unsigned PREFIX_WEIGHTS[PREFIX_FIELDS][PREFIX_MAX_VALUES] = {
+    // from file, a to h
+    { 4, 8, 8, 11, 12, 9, 9, 5 },
+    // from rank, 1 to 8
+    { 22, 20, 10, 8, 6, 4, 2, 1 },
+    // file delta, -7 to 7
+    { 1, 1, 1, 2, 3, 6, 14, 30, 14, 6, 3, 2, 1, 1, 1 },
+    // rank delta, -7 to 7
+    { 1, 1, 1, 1, 2, 4, 8, 12, 24, 10, 4, 2, 1, 1, 1 },
+};
+
+static const int PREFIX_VALUES[PREFIX_FIELDS] = { 8, 8, 15, 15 };
+
+typedef struct {
+    uint8_t length[PREFIX_MAX_VALUES];  // in bits
+    uint16_t code[PREFIX_MAX_VALUES];   // most significant bit sent first
+} prefix_code_t;
+
+static struct {
+    bool built;
+    prefix_code_t prefix[PREFIX_FIELDS];
+} module;
+
+// Writing symbols
+
+typedef struct {
+    uint8_t *symbols;
+    size_t n;
+    size_t max;
+    bool overflow;
+} writer_t;
+
+static void put(writer_t *w, uint8_t symbol) {
+    if (w->n < w->max)
+        w->symbols[w->n++] = symbol;
+    else
+        w->overflow = true;
+}
+
+/*
+ * Adds a buzz, with a gap before it if it follows another buzz.
+ */
+static void buzz(writer_t *w, uint8_t symbol) {
+    if (w->n > 0 && codebook_symbol_is_buzz(w->symbols[w->n - 1]))
+        put(w, CODEBOOK_GAP);
+    put(w, symbol);
+}
+
+static size_t finish(writer_t *w) {
+    return w->overflow ? 0 : w->n;
+}
+
+// Unary
+
+static void unary_number(writer_t *w, int n) {
+    if (n < 0) {
+        buzz(w, CODEBOOK_LONG);
+        n = -n;
+    }
+
+    // one additional buzz, so that 0 is a single buzz; the last one is longer
+    buzz(w, CODEBOOK_SHORT);
+    while (n--)
+        buzz(w, n == 0 ? CODEBOOK_MEDIUM : CODEBOOK_SHORT);
+
+    put(w, CODEBOOK_SEPARATOR);
+}
+
+static size_t unary_encode(const codebook_move_t *move, uint8_t *symbols, size_t max) {
+    writer_t w = { symbols, 0, max, false };
+
+    unary_number(&w, move->col0);
+    unary_number(&w, move->row0);
+    unary_number(&w, move->col1 - move->col0);
+    unary_number(&w, move->row1 - move->row0);
+
+    return finish(&w);
+}
+
+// Binary
+
+static void binary_number(writer_t *w, int n, int bits) {
+    while (bits--)
+        buzz(w, (n >> bits) & 1 ? CODEBOOK_MEDIUM : CODEBOOK_SHORT);
+}
+
+static size_t binary_encode(const codebook_move_t *move, uint8_t *symbols, size_t max) {
+    writer_t w = { symbols, 0, max, false };
+
+    binary_number(&w, move->col0, 3);
+    binary_number(&w, move->row0, 3);
+    put(&w, CODEBOOK_SEPARATOR);
+    binary_number(&w, move->col1, 3);
+    binary_number(&w, move->row1, 3);
+    put(&w, CODEBOOK_SEPARATOR);
+
+    return finish(&w);
+}
+
+// Balanced ternary
+
+static void trit(writer_t *w, int t) {
+    static const uint8_t TRIT_SYMBOLS[] = { CODEBOOK_SHORT, CODEBOOK_MEDIUM, CODEBOOK_LONG };
+    buzz(w, TRIT_SYMBOLS[t + 1]);
+}
+
+/*
+ * A coordinate (0 to 7) as two balanced ternary digits of coordinate - 4
+ * (which covers -4 to 4).
+ */
+static void ternary_coordinate(writer_t *w, int c) {
+    int v = c - 4;
+    int high = (v + 4) / 3 - 1;
+    int low = v - 3 * high;
+
+    trit(w, high);
+    trit(w, low);
+}
+
+static size_t ternary_encode(const codebook_move_t *move, uint8_t *symbols, size_t max) {
+    writer_t w = { symbols, 0, max, false };
+
+    ternary_coordinate(&w, move->col0);
+    ternary_coordinate(&w, move->row0);
+    put(&w, CODEBOOK_SEPARATOR);
+    ternary_coordinate(&w, move->col1);
+    ternary_coordinate(&w, move->row1);
+    put(&w, CODEBOOK_SEPARATOR);
+
+    return finish(&w);
+}
+
+// Prefix (Huffman)
+
+/*
+ * Builds a Huffman code for `n` values with the given weights, as a canonical
+ * code (codes of the same length are consecutive, in order of value).
+ */
+static void build_prefix_code(const unsigned *weights, int n, prefix_code_t *code) {
+    unsigned weight[2 * PREFIX_MAX_VALUES];
+    int parent[2 * PREFIX_MAX_VALUES];
+    bool merged[2 * PREFIX_MAX_VALUES];
+    int nodes = n;
+
+    for (int i = 0; i < n; i++) {
+        weight[i] = weights[i] ? weights[i] : 1;
+        parent[i] = -1;
+        merged[i] = false;
+    }
+
+    // repeatedly merge the two lightest nodes
+    for (int k = 0; k < n - 1; k++) {
+        int a = -1, b = -1;
+        for (int i = 0; i < nodes; i++) {
+            if (merged[i]) continue;
+            if (a < 0 || weight[i] < weight[a]) {
+                b = a;
+                a = i;
+            } else if (b < 0 || weight[i] < weight[b]) {
+                b = i;
+            }
+        }
+
+        weight[nodes] = weight[a] + weight[b];
+        parent[nodes] = -1;
+        merged[nodes] = false;
+        parent[a] = parent[b] = nodes;
+        merged[a] = merged[b] = true;
+        nodes++;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int length = 0;
+        for (int p = parent[i]; p >= 0; p = parent[p])
+            length++;
+        code->length[i] = length;
+    }
+
+    // canonical codes, shortest first
+    uint16_t next = 0;
+    int previous_length = 0;
+    for (int length = 1; length <= n; length++) {
+        for (int i = 0; i < n; i++) {
+            if (code->length[i] != length) continue;
+            next <<= length - previous_length;
+            previous_length = length;
+            code->code[i] = next++;
+        }
+    }
+}
+
+static void prefix_number(writer_t *w, int field, int value) {
+    const prefix_code_t *code = &module.prefix[field];
+    binary_number(w, code->code[value], code->length[value]);
+}
+
+static size_t prefix_encode(const codebook_move_t *move, uint8_t *symbols, size_t max) {
+    if (!module.built) {
+        for (int i = 0; i < PREFIX_FIELDS; i++)
+            build_prefix_code(PREFIX_WEIGHTS[i], PREFIX_VALUES[i], &module.prefix[i]);
+        module.built = true;
+    }
+
+    writer_t w = { symbols, 0, max, false };
+
+    // the code is self delimiting, the separators are for the wearer
+    prefix_number(&w, 0, move->col0);
+    prefix_number(&w, 1, move->row0);
+    put(&w, CODEBOOK_SEPARATOR);
+    prefix_number(&w, 2, move->col1 - move->col0 + 7);
+    prefix_number(&w, 3, move->row1 - move->row0 + 7);
+    put(&w, CODEBOOK_SEPARATOR);
+
+    return finish(&w);
+}
+
+// Move index
+
+size_t codebook_encode_index(unsigned index, uint8_t *symbols, size_t max) {
+    uint8_t digits[16];
+    int n = 0;
+
+    // bijective base two: digits 1 and 2, no zero, so every length is used
+    for (unsigned v = index + 1; v > 0; v = (v - 1) / 2)
+        digits[n++] = (v % 2) ? 1 : 2;
+
+    writer_t w = { symbols, 0, max, false };
+    while (n--)
+        buzz(&w, digits[n] == 1 ? CODEBOOK_SHORT : CODEBOOK_MEDIUM);
+    put(&w, CODEBOOK_SEPARATOR);
+
+    return finish(&w);
+}
+
+static const codebook_t CODEBOOKS[] = {
+    { "unary", unary_encode },
+    { "binary", binary_encode },
+    { "ternary", ternary_encode },
+    { "prefix", prefix_encode },
+};
+
+const codebook_t *codebook_find(const char *name) {
+    for (size_t i = 0; i < sizeof(CODEBOOKS) / sizeof(*CODEBOOKS); i++) {
+        if (strcmp(CODEBOOKS[i].name, name) == 0)
+            return &CODEBOOKS[i];
+    }
+    return NULL;
+}
+
+const codebook_t *codebook_get(size_t n) {
+    return n < sizeof(CODEBOOKS) / sizeof(*CODEBOOKS) ? &CODEBOOKS[n] : NULL;
+}
+
+bool codebook_parse_move(const char *uci, int side, codebook_move_t *move) {
+    for (int i = 0; i < 4; i++) {
+        char min = i % 2 ? '1' : 'a';
+        if (uci[i] < min || uci[i] > min + 7)
+            return false;
+    }
+
+    move->col0 = uci[0] - 'a';
+    move->row0 = uci[1] - '1';
+    move->col1 = uci[2] - 'a';
+    move->row1 = uci[3] - '1';
+
+    if (side == BLACK) {
+        move->col0 = 7 - move->col0;
+        move->row0 = 7 - move->row0;
+        move->col1 = 7 - move->col1;
+        move->row1 = 7 - move->row1;
+    }
+
+    return true;
+}
+
+unsigned long codebook_symbol_usec(uint8_t symbol) {
+    switch (symbol) {
+        case CODEBOOK_SHORT:        return CODEBOOK_SHORT_USEC;
+        case CODEBOOK_MEDIUM:       return CODEBOOK_MEDIUM_USEC;
+        case CODEBOOK_LONG:         return CODEBOOK_LONG_USEC;
+        case CODEBOOK_GAP:          return CODEBOOK_GAP_USEC;
+        case CODEBOOK_SEPARATOR:    return CODEBOOK_SEPARATOR_USEC;
+        default:                    return 0;
+    }
+}
+
+bool codebook_symbol_is_buzz(uint8_t symbol) {
+    return symbol == CODEBOOK_SHORT || symbol == CODEBOOK_MEDIUM || symbol == CODEBOOK_LONG;
+}
@@ -0,0 +1,117 @@
+#ifndef CODEBOOK_H
+#define CODEBOOK_H
+
+/*
+ * Haptic codebooks: ways of turning a move into a sequence of buzzes and
+ * pauses that the wearer of the hand can decode.
+ *
+ * Every codebook produces the same symbols (short, medium and long buzzes, and
+ * short and long pauses), so the hand plays any of them the same way and the
+ * expected delivery time of each codebook can be measured on a host (see
+ * host/codebook_bench.c). The codebooks are:
+ *
+ *  - "unary": the original encoding. Four numbers (from file, from rank, file
+ *    delta and rank delta), each as one more buzz than its value (short ones,
+ *    the last medium), with a long buzz first for negative deltas.
+ *  - "binary": the from and to squares as 3 + 3 bits each, short = 0 and
+ *    medium = 1.
+ *  - "ternary": the from and to squares, each coordinate as two balanced
+ *    ternary digits (of the coordinate minus 4), short = -1, medium = 0 and
+ *    long = +1.
+ *  - "prefix": the from square and the move vector, each of the four numbers
+ *    with a prefix (Huffman) code built from how often each value appears in
+ *    games, so common squares and moves are shorter. Short = 0, medium = 1.
+ *
+ * When both devices keep track of the game (see movegen.h), a move can instead
+ * be buzzed as its index among the legal moves of the position, which is what
+ * codebook_encode_index does. It is not a codebook_t, as it needs the position.
+ *
+ * Squares are seen from the wearer's side of the board (file 0 on their left,
+ * rank 0 closest to them).
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    CODEBOOK_IDLE = 0,
+    CODEBOOK_SHORT,         // buzz
+    CODEBOOK_MEDIUM,        // buzz
+    CODEBOOK_LONG,          // buzz
+    CODEBOOK_GAP,           // pause between buzzes
+    CODEBOOK_SEPARATOR,     // pause between numbers
+} codebook_symbol_t;
+
+#define CODEBOOK_SHORT_USEC     (1000 * 1000 / 4)
+#define CODEBOOK_MEDIUM_USEC    (1000 * 1000 / 2)
+#define CODEBOOK_LONG_USEC      (1000 * 1000)
+#define CODEBOOK_GAP_USEC       (1000 * 1000 / 6)
+#define CODEBOOK_SEPARATOR_USEC (1000 * 1000)
+
+// no codebook needs more symbols than this for a move
+#define CODEBOOK_MAX_SYMBOLS 96
+
+typedef struct {
+    int col0, row0;     // from
+    int col1, row1;     // to
+} codebook_move_t;
+
+typedef struct {
+    const char *name;
+    // writes the symbols of a move, returns how many (0 if they do not fit)
+    size_t (*encode)(const codebook_move_t *move, uint8_t *symbols, size_t max);
+} codebook_t;
+
+/*
+ * `codebook_find` looks up a codebook by name.
+ *
+ * @param name      "unary", "binary", "ternary" or "prefix"
+ * @return          the codebook, or NULL if there is none with that name
+ */
+const codebook_t *codebook_find(const char *name);
+
+/*
+ * `codebook_get` returns the n-th codebook, to go through all of them.
+ *
+ * @param n         index
+ * @return          the codebook, or NULL if `n` is past the last one
+ */
+const codebook_t *codebook_get(size_t n);
+
+/*
+ * `codebook_parse_move` reads a move in UCI notation ("e2e4", "e7e8q", the
+ * promotion is ignored) as seen by the given side.
+ *
+ * @param uci       the move
+ * @param side      WHITE or BLACK (see chess_commands.h), the wearer's side
+ * @param move      where to store the move
+ * @return          `false` if it is not a move
+ */
+bool codebook_parse_move(const char *uci, int side, codebook_move_t *move);
+
+/*
+ * `codebook_encode_index` writes the symbols of a move given as its index among
+ * the legal moves (see movegen.h): the index plus one in bijective base two,
+ * most significant digit first, short = 1 and medium = 2, then a separator. The
+ * first move is a single short buzz, and a typical position (around 40 moves)
+ * never needs more than five buzzes.
+ *
+ * @param index     the index of the move
+ * @param symbols   where to write the symbols
+ * @param max       size of `symbols`
+ * @return          how many symbols were written (0 if they do not fit)
+ */
+size_t codebook_encode_index(unsigned index, uint8_t *symbols, size_t max);
+
+/*
+ * `codebook_symbol_usec` returns how long a symbol lasts.
+ */
+unsigned long codebook_symbol_usec(uint8_t symbol);
+
+/*
+ * `codebook_symbol_is_buzz` checks whether a symbol is a buzz or a pause.
+ */
+bool codebook_symbol_is_buzz(uint8_t symbol);
+
+#endif
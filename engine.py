@@ -13,7 +13,21 @@ The serial communication works as follows (all messages are newline terminated):
     move is fed to Stockfish, which determines whether it is valid.
  - If the move is valid, the host responds with Stockfish's choice of best move.
     Otherwise, the host sends NOPE.
+ - After each of its moves (and at the start, when playing BLACK), the host
+    sends the opponent's likely replies, the most likely first, as the command
+    "/C e7e5 c7c5 e7e6". The Pi offers them first when entering the opponent's
+    move.
+ - Then, until the opponent's move arrives, the host computes its reply to the
+    most likely ones, and sends each as the command "/R e7e5 g1f3". If the
+    opponent plays one of those, the Pi plays the reply right away, and sends
+    it with the move ("MOVE_BEGIN\ne7e5 g1f3\n"). The host plays that reply,
+    and responds with it to confirm.
  - The two previous steps are repeated until the game ends.
+ - While waiting for a move, the Pi may send CANCEL instead, to take back its
+    last move and the host's reply to it (which the Pi ignores, if it arrives
+    after the CANCEL). The host responds with CANCELLED, and waits for a move
+    again. If the Pi cancels the host's first move (when playing WHITE, it never
+    arrived), the host plays it again after CANCELLED.
 """
 
 from stockfish import Stockfish
@@ -36,9 +50,25 @@ else:
     # Not Darwin, assume it's Ellen (who runs Linux)
     print("Hi Ellen!")
 
+# Every game is appended to this file, one line of UCI moves per game. It is
+# the corpus for host/codebook_bench.c (`./codebook_bench games.txt`).
+GAMES_LOG = "games.txt"
+
+# How many of the opponent's likely replies to send after every move (see
+# "/C" above), and how deep to look for them: they are computed after our
+# move is sent, while the opponent thinks, so they should be quick.
+CANDIDATES = 5
+CANDIDATES_DEPTH = 10
+
+# How many of them to compute our reply to ahead (see "/R" above), the most
+# likely first, while the opponent thinks.
+CACHED_REPLIES = 3
+
+DEPTH = 20
+
 #----------------------------------------------------------------
 
-stockfish = Stockfish(path=STOCKFISH_PATH, depth=20, parameters={
+stockfish = Stockfish(path=STOCKFISH_PATH, depth=DEPTH, parameters={
     "Threads": 4,       # Faster computations
     "Skill Level": 20,  # Max Skill
     "Hash": 2048,       # 2GB of memory
@@ -53,6 +83,8 @@ def get_move():
         if start == "MOVE_BEGIN": # Found start of a move
             move = ser.readline().decode("ascii").strip()
             break
+        elif start == "CANCEL": # Take back the last move
+            return None
         elif start: # Not a move, print for debugging purposes
             print("Pi >", start)
     print("Opp move: ", move)
@@ -83,14 +115,62 @@ def stats():
     else:
         print("No WDL stats")
 
+def queue_stats():
+    # Ask the Pi to print the state of its queues (shows up as "Pi >" lines)
+    send_command("Q")
+
+def send_candidates():
+    # The opponent's best replies are the ones they most likely play
+    if CANDIDATES == 0:
+        return []
+    stockfish.set_depth(CANDIDATES_DEPTH)
+    top = stockfish.get_top_moves(CANDIDATES)
+    stockfish.set_depth(DEPTH)
+    candidates = [m["Move"] for m in top]
+    if candidates:
+        send_command("C " + " ".join(candidates))
+    return candidates
+
+def send_cached_replies(candidates):
+    # Our reply to each of the opponent's likely moves, until their actual
+    # move arrives
+    cache = {}
+    for move in candidates[:CACHED_REPLIES]:
+        if ser.in_waiting:
+            break
+        stockfish.set_position(moves + [move])
+        reply = stockfish.get_best_move()
+        if reply:
+            cache[move] = reply
+            send_command("R " + move + " " + reply)
+    stockfish.set_position(moves)
+    return cache
+
+def log_move(move):
+    games.write(move + " ")
+    games.flush()
+
+def log_game():
+    # Log the game so far again, on a new line, after a move is taken back
+    games.write("\n" + " ".join(moves) + " ")
+    games.flush()
+
 def send_move(move):
     if len(move) > 5: # brain.c reads max 5 chars
         raise Exception("Move too long")
     move += "\n"
     ser.write(move.encode())
 
+def play_opening():
+    # When playing white, default to King's pawn.
+    stockfish.make_moves_from_current_position(["e2e4"]) # default starting move
+    moves.append("e2e4")
+    send_move("e2e4")
+    log_move("e2e4")
+    return ["e2e4"]
+
 # Open serial connection
-with serial.Serial(SERIAL_PORT, 115200, timeout=1) as ser:
+with serial.Serial(SERIAL_PORT, 115200, timeout=1) as ser, open(GAMES_LOG, "a") as games:
     # Wait for game start message
     start = ser.readline().decode("ascii").strip()
     while start != "GAME_BLACK" and start != "GAME_WHITE":
@@ -101,15 +181,36 @@ with serial.Serial(SERIAL_PORT, 115200, timeout=1) as ser:
 
     # Send game start message
     ser.write("READY\n".encode())
+    games.write("\n")
+
+    moves = []      # the game so far
+    last_moves = [] # added by the last move received, taken back by CANCEL
 
-    # When playing white, default to King's pawn.
     if player == "WHITE":
-        stockfish.make_moves_from_current_position(["e2e4"]) # default starting move
-        send_move("e2e4")
+        last_moves = play_opening()
+
+    cache = send_cached_replies(send_candidates())
 
     while True:
         # Get move
-        opp_move = get_move().strip()
+        opp_move = get_move()
+
+        if opp_move is None:
+            print("Cancelled: ", last_moves)
+            if last_moves:
+                del moves[-len(last_moves):]
+                last_moves = []
+                stockfish.set_position(moves)
+                log_game()
+            ser.write("CANCELLED\n".encode())
+            if player == "WHITE" and not moves:
+                last_moves = play_opening()
+            cache = send_cached_replies(send_candidates())
+            continue
+
+        # The Pi sends the reply it already played, if it had it cached
+        opp_move, _, played = opp_move.strip().partition(" ")
+        last_moves = []
 
         try:
             # Stockfish will throw an exception if a move is invalid
@@ -118,17 +219,35 @@ with serial.Serial(SERIAL_PORT, 115200, timeout=1) as ser:
             print("Invalid move")
             send_move("NOPE")
             continue
-        
+
+        moves.append(opp_move)
+        last_moves.append(opp_move)
+        log_move(opp_move)
+
         # Compute our best move. Stockfish will return None if checkmate.
-        best_move = stockfish.get_best_move()
+        # The reply the Pi played is only kept if it is the one we computed
+        # (otherwise our actual choice is sent, and the Pi corrects it)
+        if played and cache.get(opp_move) == played:
+            best_move = played
+        elif opp_move in cache:
+            best_move = cache[opp_move]
+        else:
+            best_move = stockfish.get_best_move()
+        cache = {}
 
         if best_move is None:
             best_move = "/MATE"
         else:
             stockfish.make_moves_from_current_position([best_move])
+            moves.append(best_move)
+            last_moves.append(best_move)
+            log_move(best_move)
 
         print("Stockfish move: ", best_move)
 
         # stats()
+        # queue_stats()
         send_move(best_move)
+        if not best_move.startswith("/"):
+            cache = send_cached_replies(send_candidates())
 
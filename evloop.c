@@ -0,0 +1,235 @@
+/*
+ * Event loop which runs the ready task with the earliest deadline, and sleeps
+ * with wfi when idle (see evloop.h).
+ */
+#include "evloop.h"
+#include "alarm.h"
+#include "irq.h"
+#include "printf.h"
+#include "timer.h"
+#include <stddef.h>
+
+typedef struct {
+    const char *name;
+    evloop_ready_fn_t ready;    // NULL for timer and periodic tasks
+    evloop_run_fn_t run;
+    void *aux_data;
+    unsigned long budget;       // ticks
+
+    // timer and periodic tasks: set by the alarm
+    alarm_t alarm;
+    unsigned long period;       // ticks, 0 if not periodic
+    volatile bool due;
+    volatile unsigned long due_at;
+
+    // became ready at `release`, not run yet
+    bool released;
+    unsigned long release;
+
+    unsigned long runs;
+    volatile unsigned long missed;
+    unsigned long run_ticks;
+    unsigned long max_run_ticks;
+    unsigned long max_latency_ticks;
+} task_t;
+
+static struct {
+    task_t tasks[EVLOOP_MAX_TASKS];
+    int ntasks;
+
+    unsigned long start;        // ticks
+    unsigned long wakeups;
+    unsigned long sleep_ticks;
+} module;
+
+/*
+ * Waits for an interrupt. Interrupts must be masked, the pending one is taken
+ * after unmasking.
+ */
+static inline void wait_for_interrupt(void) {
+#if defined(__riscv)
+    __asm__ volatile ("wfi" : : : "memory");
+#endif
+}
+
+static bool is_ready(task_t *task) {
+    return task->ready ? task->ready(task->aux_data) : task->due;
+}
+
+static bool any_ready(void) {
+    for (int i = 0; i < module.ntasks; i++) {
+        if (is_ready(&module.tasks[i]))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Alarm function of timer and periodic tasks.
+ */
+static void task_due(void *aux_data) {
+    task_t *task = aux_data;
+    unsigned long deadline = task->alarm.deadline;
+
+    if (task->period) {
+        // the previous period has not run yet: this one is lost
+        if (task->due)
+            task->missed++;
+        alarm_set_at(&task->alarm, deadline + task->period, task_due, task);
+    }
+
+    if (!task->due)
+        task->due_at = deadline;
+    task->due = true;
+}
+
+/*
+ * Notes when tasks become ready, and picks the one with the earliest deadline.
+ */
+static task_t *next_task(void) {
+    unsigned long now = timer_get_ticks();
+    task_t *next = NULL;
+
+    for (int i = 0; i < module.ntasks; i++) {
+        task_t *task = &module.tasks[i];
+
+        if (!task->released && is_ready(task)) {
+            task->released = true;
+            task->release = task->ready ? now : task->due_at;
+        }
+
+        if (task->released && (next == NULL
+                || (long)((task->release + task->budget) - (next->release + next->budget)) < 0))
+            next = task;
+    }
+
+    return next;
+}
+
+static void run_task(task_t *task) {
+    unsigned long start = timer_get_ticks();
+    unsigned long latency = start - task->release;
+
+    if (latency > task->budget)
+        task->missed++;
+    if (latency > task->max_latency_ticks)
+        task->max_latency_ticks = latency;
+
+    // before running, so that it may schedule itself again
+    task->released = false;
+    task->due = false;
+
+    task->run(task->aux_data);
+
+    unsigned long elapsed = timer_get_ticks() - start;
+    task->runs++;
+    task->run_ticks += elapsed;
+    if (elapsed > task->max_run_ticks)
+        task->max_run_ticks = elapsed;
+}
+
+static int add_task(const char *name, evloop_ready_fn_t ready, evloop_run_fn_t run,
+        void *aux_data, unsigned long budget_usec) {
+    if (module.ntasks == EVLOOP_MAX_TASKS)
+        return -1;
+
+    task_t *task = &module.tasks[module.ntasks];
+    task->name = name;
+    task->ready = ready;
+    task->run = run;
+    task->aux_data = aux_data;
+    task->budget = budget_usec * TICKS_PER_USEC;
+    task->alarm.pending = false;
+
+    return module.ntasks++;
+}
+
+int evloop_add(const char *name, evloop_ready_fn_t ready, evloop_run_fn_t run,
+        void *aux_data, unsigned long budget_usec) {
+    return add_task(name, ready, run, aux_data, budget_usec);
+}
+
+int evloop_add_timer(const char *name, evloop_run_fn_t run, void *aux_data,
+        unsigned long budget_usec) {
+    alarm_init();
+    return add_task(name, NULL, run, aux_data, budget_usec);
+}
+
+int evloop_add_periodic(const char *name, unsigned long period_usec, evloop_run_fn_t run,
+        void *aux_data, unsigned long budget_usec) {
+    int n = evloop_add_timer(name, run, aux_data, budget_usec);
+    if (n < 0)
+        return -1;
+
+    task_t *task = &module.tasks[n];
+    task->period = period_usec * TICKS_PER_USEC;
+    alarm_set(&task->alarm, period_usec, task_due, task);
+
+    return n;
+}
+
+void evloop_schedule(int n, unsigned long usec) {
+    task_t *task = &module.tasks[n];
+
+    // if the alarm already fired but the task has not run, it runs only at
+    // the new time
+    unsigned long flags = irq_save();
+    task->due = false;
+    task->released = false;
+    alarm_set(&task->alarm, usec, task_due, task);
+    irq_restore(flags);
+}
+
+void evloop_cancel(int n) {
+    task_t *task = &module.tasks[n];
+
+    unsigned long flags = irq_save();
+    alarm_cancel(&task->alarm);
+    task->due = false;
+    task->released = false;
+    irq_restore(flags);
+}
+
+bool evloop_scheduled(int n) {
+    task_t *task = &module.tasks[n];
+    return alarm_pending(&task->alarm) || task->due;
+}
+
+void evloop_run(void) {
+    module.start = timer_get_ticks();
+
+    while (1) {
+        task_t *task = next_task();
+        if (task != NULL) {
+            run_task(task);
+            continue;
+        }
+
+        unsigned long flags = irq_save();
+        if (!any_ready()) {
+            unsigned long before = timer_get_ticks();
+            wait_for_interrupt();
+            module.sleep_ticks += timer_get_ticks() - before;
+            module.wakeups++;
+        }
+        irq_restore(flags);
+    }
+}
+
+void evloop_dump(void) {
+    unsigned long total = timer_get_ticks() - module.start;
+    unsigned long percent = total / 100 ? module.sleep_ticks / (total / 100) : 0;
+
+    printf("evloop: %d tasks, %lu wakeups, asleep %lu%% of the time\n",
+            module.ntasks, module.wakeups, percent);
+
+    for (int i = 0; i < module.ntasks; i++) {
+        task_t *task = &module.tasks[i];
+        unsigned long mean = task->runs ? task->run_ticks / task->runs : 0;
+
+        printf("  %s: %lu runs, %lu/%lu us (mean/max), waited up to %lu us, %lu missed\n",
+                task->name, task->runs, mean / TICKS_PER_USEC,
+                task->max_run_ticks / TICKS_PER_USEC,
+                task->max_latency_ticks / TICKS_PER_USEC, task->missed);
+    }
+}
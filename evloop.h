@@ -0,0 +1,121 @@
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+/*
+ * Main loop which sleeps until there is something to do, and then does the
+ * most urgent thing first. Work is queued by interrupt handlers (GPIO, UART,
+ * timers), and the loop runs whatever became ready as soon as the interrupt
+ * returns, instead of spinning or sleeping for a fixed time.
+ *
+ * A task is a function which runs to completion (there is no preemption, so it
+ * must not wait for anything). It becomes ready either
+ *  - when its `ready` function says so (for example, a queue filled by an
+ *    interrupt is not empty), added with evloop_add, or
+ *  - at a time, once (evloop_add_timer and evloop_schedule) or periodically
+ *    (evloop_add_periodic), using an alarm (see alarm.h).
+ *
+ * Every task has a deadline: its budget after it became ready. Among the ready
+ * tasks, the one whose deadline comes first runs first. A task which starts
+ * after its deadline counts as a missed deadline, and so does a periodic task
+ * which is still waiting to run when its next period comes (that run is
+ * skipped). evloop_dump prints these counters, with how long each task takes
+ * to run and to start, to see which task delays which.
+ *
+ * When nothing is ready, the loop checks again with interrupts masked and waits
+ * for an interrupt (wfi). Checking with interrupts masked means an interrupt
+ * arriving right before the wfi is not lost: it stays pending, so wfi returns
+ * immediately, and it is handled once interrupts are unmasked again.
+ *
+ * `ready` may be called with or without interrupts masked, so it must be quick
+ * and must not wait.
+ */
+
+#include <stdbool.h>
+
+#define EVLOOP_MAX_TASKS 8
+
+typedef bool (*evloop_ready_fn_t)(void *aux_data);
+typedef void (*evloop_run_fn_t)(void *aux_data);
+
+/*
+ * `evloop_add` adds a task which runs whenever `ready` returns `true`.
+ *
+ * @param name          for evloop_dump
+ * @param ready         returns `true` when `run` has something to do
+ * @param run           does the work
+ * @param aux_data      passed to both
+ * @param budget_usec   how soon after becoming ready it should start
+ * @return              its number, -1 if there are already EVLOOP_MAX_TASKS
+ */
+int evloop_add(const char *name, evloop_ready_fn_t ready, evloop_run_fn_t run,
+        void *aux_data, unsigned long budget_usec);
+
+/*
+ * `evloop_add_timer` adds a task which runs once every time it is scheduled
+ * with evloop_schedule.
+ *
+ * @param name          for evloop_dump
+ * @param run           does the work
+ * @param aux_data      passed to it
+ * @param budget_usec   how soon after the time it is scheduled for it should
+ *                          start
+ * @return              its number, -1 if there are already EVLOOP_MAX_TASKS
+ */
+int evloop_add_timer(const char *name, evloop_run_fn_t run, void *aux_data,
+        unsigned long budget_usec);
+
+/*
+ * `evloop_add_periodic` adds a task which runs every `period_usec`, starting
+ * one period from now. The periods do not drift, however late the task runs.
+ *
+ * @param name          for evloop_dump
+ * @param period_usec   time between runs
+ * @param run           does the work
+ * @param aux_data      passed to it
+ * @param budget_usec   how soon after the start of each period it should start
+ * @return              its number, -1 if there are already EVLOOP_MAX_TASKS
+ */
+int evloop_add_periodic(const char *name, unsigned long period_usec, evloop_run_fn_t run,
+        void *aux_data, unsigned long budget_usec);
+
+/*
+ * `evloop_schedule` makes a timer task run once, `usec` from now. If it was
+ * already scheduled and has not run yet (even if its time has come), it is
+ * moved to the new time.
+ *
+ * @param task          as returned by evloop_add_timer
+ * @param usec          delay
+ */
+void evloop_schedule(int task, unsigned long usec);
+
+/*
+ * `evloop_cancel` keeps a timer task from running, if it was scheduled or
+ * ready.
+ *
+ * @param task          as returned by evloop_add_timer
+ */
+void evloop_cancel(int task);
+
+/*
+ * `evloop_scheduled` checks whether a timer task is scheduled or ready, that
+ * is, whether it will run without calling evloop_schedule again.
+ *
+ * @param task          as returned by evloop_add_timer
+ * @return              `true` if it will run
+ */
+bool evloop_scheduled(int task);
+
+/*
+ * `evloop_run` runs the loop forever.
+ */
+void evloop_run(void) __attribute__((noreturn));
+
+/*
+ * `evloop_dump` prints how many times the loop woke up and how much of the
+ * time it slept, and for every task how many times it ran, how long it took
+ * (on average and at most), how long it waited to start (at most) and how
+ * many deadlines it missed.
+ */
+void evloop_dump(void);
+
+#endif
@@ -1,24 +1,27 @@
-#include "assert.h"
 #include "chess_commands.h"
+#include "buzz.h"
+#include "buzz_player.h"
+#include "codebook.h"
+#include "evloop.h"
 #include "gpio.h"
 #include "interrupts.h"
 #include "jnxu.h"
-#include "malloc.h"
+#include "move_entry.h"
+#include "movegen.h"
+#include "transport.h"
 #include "printf.h"
-#include "ringbuffer.h"
 #include "re.h"
+#include "ringq.h"
+#include "servo.h"
 #include "timer.h"
 #include "uart.h"
+#include "strings.h"
 #include <stdint.h>
 
 #define RE_CLOCK GPIO_PB0
 #define RE_DATA GPIO_PD22
 #define RE_SW GPIO_PD21 // (button)
 
-#define RE_TIMEOUT_USEC (200 * 1000) // 200ms
-
-#define MIN_TICKS   4 // minimum number of RE events to treat as turn
-
 #define SERVO_PIN GPIO_PB1
 
 #define MGPIA_MAC "685E1C4C31FD"
@@ -27,225 +30,459 @@
 #define BT_MODE BT_EXT_ROLE_PRIMARY
 #define BT_MAC  MGPIA_MAC
 
-#define TICKS_PER_SECOND    (1000 * 1000 * TICKS_PER_USEC)
+// see codebook.h, only for brains which send plain moves (newer ones compile
+// the buzz program themselves) and when the position is out of sync
+#define HAND_CODEBOOK "unary"
 
-#define SERVO_PULSE_LONG_USEC   1000
-#define SERVO_PULSE_SHORT_USEC  1200
-#define SERVO_PERIOD_USEC       20 * 1000
+// send the brain where the cursor is, at most this often, for the screen (the
+// move itself is sent as soon as it is entered)
+#define HAND_MIRROR_CURSOR 1
+#define HAND_MIRROR_USEC (100 * 1000)
 
-#define BUZZ_DURATION_TICKS             (TICKS_PER_SECOND / 4)
-#define BUZZ_WAIT_DURATION_TICKS        (TICKS_PER_SECOND / 6)
-#define LAST_BUZZ_DURATION_TICKS        (TICKS_PER_SECOND / 2)
-#define LONG_BUZZ_DURATION_TICKS        (TICKS_PER_SECOND / 1)
-#define LONG_BUZZ_WAIT_DURATION_TICKS   (TICKS_PER_SECOND / 1)
+// the cursor only stops where a legal move can go (see move_entry_follow),
+// while the position is in sync
+#define HAND_SNAP_CURSOR 1
 
-#define MAX(a, b) ((a) > (b) ? (a) : (b))
+// deadlines of the main loop's tasks (see evloop.h): the encoder first, since
+// the wearer feels it, then what is sent to the brain
+#define HAND_ENCODER_BUDGET_USEC (5 * 1000)
+#define HAND_BRAIN_BUDGET_USEC (10 * 1000)
+#define HAND_LINK_BUDGET_USEC (50 * 1000)
 
-enum {
-    BUZZ_IDLE = 0,
-    BUZZ,
-    LAST_BUZZ,
-    LONG_BUZZ,
-    BUZZ_WAIT,
-    LONG_BUZZ_WAIT,
-};
+// messages from the brain waiting for the main loop, and the longest one kept
+// (a buzz program with its tag)
+#define HAND_BRAIN_QUEUE_LENGTH 8
+#define HAND_BRAIN_MESSAGE_LEN (1 + BUZZ_MAX_PROGRAM)
+
+// how often the tasks' statistics are printed
+#define HAND_STATS_USEC (30 * 1000 * 1000)
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+// a message from the brain, received in the interrupt and handled by fn in the
+// main loop
+typedef struct {
+    jnxu_handler_t fn;
+    uint8_t len;
+    uint8_t message[HAND_BRAIN_MESSAGE_LEN];
+} brain_message_t;
+
+RINGQ_DECLARE(brain_queue, brain_message_t, HAND_BRAIN_QUEUE_LENGTH)
 
 static struct {
     re_device_t *re;
-    rb_t *buzzes;
+    const codebook_t *codebook;
+    movegen_position_t position;
+    bool in_sync;   // the position is the same as the brain's
+    movegen_position_t history[CMD_TAKEBACK_MAX];   // before the last moves
+    int nhistory;
+
+    // the opponent's likely moves, set by the radio's handlers
+    movegen_move_t candidates[MOVE_ENTRY_MAX_CANDIDATES];
+    int ncandidates;
+    bool candidates_changed;
+    move_entry_t entry;
+    int mirror_task;
+
+    // the brain's messages, queued by the interrupt so that the state above
+    // is only ever touched by the main loop
+    brain_queue_t brain_messages;
 } module;
 
-static void enqueue_buzzes(int n) {
-    if (n < 0) {
-        rb_enqueue(module.buzzes, LONG_BUZZ);
-        rb_enqueue(module.buzzes, BUZZ_WAIT);
-        n = -n;
+/*
+ * Queues symbols to be played. Nothing to play (0 symbols) is reported as
+ * rejected, like an invalid program.
+ */
+static void play_symbols(const uint8_t *symbols, size_t n, uint8_t tag) {
+    uint8_t program[BUZZ_MAX_PROGRAM];
+    size_t program_len = n ? buzz_compile(symbols, n, program, sizeof(program)) : 0;
+
+    buzz_player_enqueue(program, program_len, BUZZ_PLAYER_NORMAL, tag);
+}
+
+/*
+ * Buzzes a move in UCI notation with the hand's codebook.
+ */
+static void buzz_move(const char *uci, uint8_t tag) {
+    codebook_move_t move;
+    uint8_t symbols[CODEBOOK_MAX_SYMBOLS];
+    size_t n = 0;
+
+    if (codebook_parse_move(uci, PLAYING, &move))
+        n = module.codebook->encode(&move, symbols, sizeof(symbols));
+
+    printf("Enqueueing %d symbols (%s)\n", (int)n, module.codebook->name);
+    play_symbols(symbols, n, tag);
+}
+
+static void move_handler(void *aux_data, const uint8_t *message, size_t len) {
+    // plain moves have no tag (see CMD_DELIVERY)
+    uint8_t tag = 0;
+
+    if (len < 5 || (message[4] != '\n' && message[5] != '\n')) {
+        play_symbols(NULL, 0, tag);
+        return;
     }
 
-    printf("Enqueueing %d\n", n);
+    buzz_move((const char *)message, tag);
+}
 
-    // one additional buzz
-    rb_enqueue(module.buzzes, BUZZ);
+/*
+ * Expands the index of a CMD_MOVE_INDEX or CMD_MOVE_PLAYED message into the
+ * move and plays it on the hand's position. Once the position is found to be
+ * out of sync with the brain's, indexes are not trusted anymore.
+ *
+ * @return          `false` if the position is out of sync
+ */
+static bool play_indexed(const uint8_t *message, size_t len, char uci[6]) {
+    memset(uci, 0, 6);
+    memcpy(uci, message + 2, MIN(len - 2, 5));
+
+    if (!module.in_sync)
+        return false;
+
+    movegen_move_t moves[MOVEGEN_MAX_MOVES];
+    size_t count = movegen_generate(&module.position, moves);
+
+    char expanded[6] = "";
+    if (message[0] < count)
+        movegen_format(&moves[message[0]], expanded);
+
+    if (count != message[1] || strcmp(expanded, uci) != 0) {
+        printf("Position out of sync (%s is not move %d of %d)\n", uci, message[0], (int)count);
+        module.in_sync = false;
+        return false;
+    }
 
-    while (n--) {
-        rb_enqueue(module.buzzes, BUZZ_WAIT);
-        if (n == 0)
-            rb_enqueue(module.buzzes, LAST_BUZZ);
-        else
-            rb_enqueue(module.buzzes, BUZZ);
+    // remembered for CMD_TAKEBACK, dropping the oldest
+    if (module.nhistory == CMD_TAKEBACK_MAX) {
+        for (int i = 1; i < CMD_TAKEBACK_MAX; i++)
+            module.history[i - 1] = module.history[i];
+        module.nhistory--;
     }
+    module.history[module.nhistory++] = module.position;
+
+    movegen_apply(&module.position, &moves[message[0]]);
 
-    rb_enqueue(module.buzzes, LONG_BUZZ_WAIT);
+    // the candidates were for the move just played
+    module.ncandidates = 0;
+    module.candidates_changed = true;
+    return true;
 }
 
-static void move_handler(void *aux_data, const uint8_t *message, size_t len) {
-    if (len < 5 || (message[4] != '\n' && message[5] != '\n'))
+static void move_index_handler(void *aux_data, const uint8_t *message, size_t len) {
+    if (len < 1)
+        return;
+
+    // the rest is like CMD_MOVE_PLAYED
+    uint8_t tag = message[0];
+    message++;
+    len--;
+
+    if (len < 6) {
+        play_symbols(NULL, 0, tag);
         return;
+    }
 
-    int col0 = message[0] - 'a';
-    int row0 = message[1] - '1';
+    char uci[6];
+    if (!play_indexed(message, len, uci)) {
+        buzz_move(uci, tag);
+        return;
+    }
 
-    int col1 = message[2] - 'a';
-    int row1 = message[3] - '1';
+    uint8_t symbols[CODEBOOK_MAX_SYMBOLS];
+    size_t n = codebook_encode_index(message[0], symbols, sizeof(symbols));
 
-#if PLAYING == BLACK
-    enqueue_buzzes(7 - col0);
-    enqueue_buzzes(7 - row0);
-#else
-    enqueue_buzzes(col0);
-    enqueue_buzzes(row0);
-#endif
+    printf("Enqueueing %s as move %d of %d\n", uci, message[0], message[1]);
+    play_symbols(symbols, n, tag);
+}
+
+static void move_played_handler(void *aux_data, const uint8_t *message, size_t len) {
+    if (len < 6)
+        return;
 
-    enqueue_buzzes(PLAYING * (col1 - col0));
-    enqueue_buzzes(PLAYING * (row1 - row0));
+    char uci[6];
+    play_indexed(message, len, uci);
 }
 
-int main(void) {
-    gpio_init();
-    uart_init();
-    interrupts_init();
-    interrupts_global_enable();
+/*
+ * Takes back the last moves played (see CMD_TAKEBACK). If they are not
+ * remembered, or the position before them does not match the brain's, the
+ * position is out of sync.
+ */
+static void takeback_handler(void *aux_data, const uint8_t *message, size_t len) {
+    if (len < 2 || message[0] == 0 || !module.in_sync)
+        return;
 
-    module.buzzes = rb_new();
-    module.re = re_new(RE_CLOCK, RE_DATA, RE_SW);
+    int n = message[0];
+    movegen_move_t moves[MOVEGEN_MAX_MOVES];
+    if (n > module.nhistory ||
+            movegen_generate(&module.history[module.nhistory - n], moves) != message[1]) {
+        printf("Position out of sync (cannot take back %d moves)\n", n);
+        module.in_sync = false;
+        return;
+    }
 
-    gpio_set_output(SERVO_PIN);
+    module.nhistory -= n;
+    module.position = module.history[module.nhistory];
 
-    jnxu_init(BT_MODE, BT_MAC);
-    jnxu_register_handler(CMD_MOVE, move_handler, NULL);
+    // the candidates were for a position taken back
+    module.ncandidates = 0;
+    module.candidates_changed = true;
+}
 
-    // In ticks
-    unsigned long buzzer_start = 0;
-    unsigned long buzzer_duration = 0;
+static void buzz_handler(void *aux_data, const uint8_t *message, size_t len) {
+    if (len < 1)
+        return;
+
+    if (!buzz_player_enqueue(message + 1, len - 1, BUZZ_PLAYER_NORMAL, message[0]))
+        printf("Rejected buzz program (%d bytes)\n", (int)len - 1);
+}
 
-    unsigned long buzzer_next_pulse_time = 0;
+static void buzz_urgent_handler(void *aux_data, const uint8_t *message, size_t len) {
+    if (len < 1)
+        return;
 
-    int buzzer_pulse_a = SERVO_PULSE_LONG_USEC;
-    int buzzer_pulse_b = SERVO_PULSE_SHORT_USEC;
+    if (!buzz_player_enqueue(message + 1, len - 1, BUZZ_PLAYER_URGENT, message[0]))
+        printf("Rejected urgent buzz program (%d bytes)\n", (int)len - 1);
+}
 
-    int buzzer_status = BUZZ_IDLE;
-    bool buzz_waiting = false;
+/*
+ * The opponent's likely moves (see CMD_CANDIDATES), offered the next time the
+ * move entry starts over. Ignored if the position is out of sync.
+ */
+static void candidates_handler(void *aux_data, const uint8_t *message, size_t len) {
+    if (len < 1 || !module.in_sync)
+        return;
 
-    int cw = 0;
-    int ccw = 0;
-    unsigned long last_re_event = 0;
+    movegen_move_t moves[MOVEGEN_MAX_MOVES];
+    size_t count = movegen_generate(&module.position, moves);
+    if (count != message[0])
+        return;
 
-    while (1) {
-        // rotary encoder
-        re_event_t *event = re_read(module.re);
+    int n = 0;
+    for (size_t i = 1; i < len && n < MOVE_ENTRY_MAX_CANDIDATES; i++) {
+        if (message[i] < count)
+            module.candidates[n++] = moves[message[i]];
+    }
+    module.ncandidates = n;
+    module.candidates_changed = true;
+}
 
-        while (event) {
-last_update:
-            if (event->ticks - last_re_event > RE_TIMEOUT_USEC * TICKS_PER_USEC) {
-                if (MAX(ccw, cw) > MIN_TICKS) {
-                    // send cursor packet
-                    uint8_t motion;
-                    if (cw > ccw)
-                        motion = MOTION_CW;
-                    else
-                        motion = MOTION_CCW;
+static bool report_ready(void *aux_data) {
+    return buzz_player_has_report();
+}
 
-                    uint8_t buf[] = { motion };
+/*
+ * Tells the brain what became of the messages it asked to buzz, all the
+ * reports there are in one message.
+ */
+static void send_reports(void *aux_data) {
+    uint8_t message[2 * BUZZ_PLAYER_REPORT_LENGTH];
+    size_t len = 0;
+
+    buzz_player_report_t report;
+    while (len < sizeof(message) && buzz_player_next_report(&report)) {
+        message[len++] = report.tag;
+        message[len++] = report.outcome;
+    }
 
-                    jnxu_send(CMD_CURSOR, buf, sizeof(buf));
-                }
+    jnxu_send(CMD_DELIVERY, message, len);
+}
 
-                cw = ccw = 0;
-            }
+/*
+ * Schedules sending the cursor to the brain. Whatever changes until then goes
+ * in the same message, so turning the knob fast sends one message every
+ * HAND_MIRROR_USEC instead of one per gesture.
+ */
+static void mirror_later(void) {
+#if HAND_MIRROR_CURSOR
+    if (!evloop_scheduled(module.mirror_task))
+        evloop_schedule(module.mirror_task, HAND_MIRROR_USEC);
+#endif
+}
 
-            switch (event->type) {
-                case RE_EVENT_CLOCKWISE:
-                    printf("+\n");
-                    cw++;
-                    last_re_event = event->ticks;
-                    break;
+/*
+ * Sends where the cursor is now (see CMD_CURSOR_STATE).
+ */
+static void send_mirror(void *aux_data) {
+    const move_entry_t *entry = &module.entry;
+    uint8_t message[] = {
+        entry->state, entry->cursor_x, entry->cursor_y, entry->cursor_promotion + 1,
+        entry->move[0], entry->move[1], entry->cursor_candidate,
+    };
+
+    jnxu_send(CMD_CURSOR_STATE, message, sizeof(message));
+}
 
-                case RE_EVENT_COUNTERCLOCKWISE:
-                    printf("-\n");
-                    ccw++;
-                    last_re_event = event->ticks;
-                    break;
+/*
+ * Sends the move just entered to the brain, and starts over.
+ */
+static void submit_entry(void) {
+    char uci[6];
+    move_entry_uci(&module.entry, PLAYING, uci);
 
-                case RE_EVENT_PUSH:
-                    {
-                        printf("Sending Button\n");
-                        jnxu_send(CMD_PRESS, NULL, 0);
-                    }
-                    break;
+    printf("Sending %s\n", uci);
+    jnxu_send(CMD_SUBMIT, (const uint8_t *)uci, strlen(uci));
 
-                case RE_EVENT_NONE:
-                    goto back_from_last_update;
+    move_entry_reset(&module.entry);
+}
 
-                default:
-                    break;
-            }
+/*
+ * Makes the cursor follow the position, while it is in sync, and offer the
+ * latest candidates, after the radio's handlers changed them. New candidates
+ * start the move over, unless a piece is chosen.
+ */
+static void update_entry(void) {
+#if HAND_SNAP_CURSOR
+    move_entry_follow(&module.entry, module.in_sync ? &module.position : NULL, PLAYING);
+#endif
 
-            free(event);
-            event = re_read(module.re);
+    if (module.candidates_changed) {
+        module.candidates_changed = false;
+        move_entry_candidates(&module.entry, module.candidates, module.ncandidates, PLAYING);
+        if (!move_entry_piece_chosen(&module.entry)) {
+            move_entry_reset(&module.entry);
+            mirror_later();
         }
+    }
+}
 
-        re_event_t phony_event = {
-            .ticks = timer_get_ticks(),
-            .type = RE_EVENT_NONE
-        };
-
-        event = &phony_event;
-        goto last_update;
-back_from_last_update:
-
-        // buzzer
-        if (buzzer_status != BUZZ_IDLE) {
-            unsigned long now = timer_get_ticks();
-            unsigned long dt = now - buzzer_start;
-
-            if (dt > buzzer_duration) {
-                buzzer_status = BUZZ_IDLE;
-            } else if (!buzz_waiting) {
-                if (now > buzzer_next_pulse_time) {
-                    gpio_write(SERVO_PIN, 1);
-                    timer_delay_us(buzzer_pulse_a);
-                    gpio_write(SERVO_PIN, 0);
-
-                    buzzer_next_pulse_time = timer_get_ticks() + (
-                            SERVO_PERIOD_USEC - buzzer_pulse_a
-                            ) * TICKS_PER_USEC;
-
-                    int tmp = buzzer_pulse_a;
-                    buzzer_pulse_a = buzzer_pulse_b;
-                    buzzer_pulse_b = tmp;
-                }
-            }
-        } else if (!rb_empty(module.buzzes)) {
-            assert(rb_dequeue(module.buzzes, &buzzer_status));
-
-            buzzer_start = timer_get_ticks();
-
-            switch (buzzer_status) {
-                case BUZZ:
-                    buzzer_duration = BUZZ_DURATION_TICKS;
-                    buzz_waiting = false;
-                    break;
-                
-                case LAST_BUZZ:
-                    buzzer_duration = LAST_BUZZ_DURATION_TICKS;
-                    buzz_waiting = false;
-                    break;
-
-                case LONG_BUZZ:
-                    buzzer_duration = LONG_BUZZ_DURATION_TICKS;
-                    buzz_waiting = false;
-                    break;
-
-                case BUZZ_WAIT:
-                    buzzer_duration = BUZZ_WAIT_DURATION_TICKS;
-                    buzz_waiting = true;
-                    break;
-
-                case LONG_BUZZ_WAIT:
-                    buzzer_duration = LONG_BUZZ_WAIT_DURATION_TICKS;
-                    buzz_waiting = true;
-                    break;
-            }
+static bool encoder_ready(void *aux_data) {
+    return re_has_event(module.re);
+}
+
+/*
+ * Turns the encoder's gestures into the move being entered.
+ */
+static void handle_encoder(void *aux_data) {
+    re_event_t event;
+    update_entry();
+
+    while (re_read(module.re, &event)) {
+        switch (event.type) {
+            case RE_EVENT_CLOCKWISE:
+            case RE_EVENT_COUNTERCLOCKWISE:
+                printf(event.steps > 0 ? "+%d\n" : "%d\n", event.steps);
+                continue;
+
+            case RE_EVENT_GESTURE:
+                // the burst is over: move by the number of squares
+                move_entry_cursor(&module.entry, event.steps, false);
+                break;
+
+            case RE_EVENT_PRESS_TURN:
+                // turned with the button held: the other axis
+                move_entry_cursor(&module.entry, event.steps, true);
+                break;
+
+            case RE_EVENT_PUSH:
+                if (move_entry_press(&module.entry))
+                    submit_entry();
+                break;
+
+            case RE_EVENT_DOUBLE_PRESS:
+                if (move_entry_confirm(&module.entry))
+                    submit_entry();
+                break;
+
+            case RE_EVENT_LONG_PRESS:
+                // also takes back the move sent, if the engine has not
+                // answered it yet
+                printf("Reset\n");
+                move_entry_reset(&module.entry);
+                jnxu_send(CMD_RESET_MOVE, NULL, 0);
+                break;
+
+            default:
+                continue;
         }
+
+        mirror_later();
     }
 }
+
+// handlers of the brain's messages, run by handle_brain_message
+static const struct {
+    uint8_t cmd;
+    jnxu_handler_t fn;
+} BRAIN_HANDLERS[] = {
+    { CMD_MOVE, move_handler },
+    { CMD_BUZZ, buzz_handler },
+    { CMD_BUZZ_URGENT, buzz_urgent_handler },
+    { CMD_MOVE_INDEX, move_index_handler },
+    { CMD_MOVE_PLAYED, move_played_handler },
+    { CMD_CANDIDATES, candidates_handler },
+    { CMD_TAKEBACK, takeback_handler },
+};
+
+/*
+ * JNXU handler (in the interrupt) of every message from the brain: queues it,
+ * along with the function which handles it in the main loop. Those generate
+ * the legal moves and compile buzz programs, which would hold off the encoder
+ * and the alarms for too long in the interrupt. A message which does not fit
+ * is dropped (the queue counts it when full).
+ *
+ * @param aux_data  index of the message's entry in BRAIN_HANDLERS
+ */
+static void queue_brain_message(void *aux_data, const uint8_t *message, size_t len) {
+    if (len > HAND_BRAIN_MESSAGE_LEN)
+        return;
+
+    brain_message_t *queued = brain_queue_claim(&module.brain_messages);
+    if (queued == NULL)
+        return;
+
+    queued->fn = BRAIN_HANDLERS[(uintptr_t)aux_data].fn;
+    queued->len = len;
+    memcpy(queued->message, message, len);
+    brain_queue_publish(&module.brain_messages);
+}
+
+static bool brain_message_ready(void *aux_data) {
+    return !brain_queue_empty(&module.brain_messages);
+}
+
+static void handle_brain_message(void *aux_data) {
+    brain_message_t message;
+    if (!brain_queue_dequeue(&module.brain_messages, &message))
+        return;
+
+    message.fn(NULL, message.message, message.len);
+    update_entry();
+}
+
+static void print_stats(void *aux_data) {
+    evloop_dump();
+}
+
+int main(void) {
+    gpio_init();
+    uart_init();
+    interrupts_init();
+    interrupts_global_enable();
+
+    module.codebook = codebook_find(HAND_CODEBOOK);
+    module.re = re_new(RE_CLOCK, RE_DATA, RE_SW);
+    movegen_init(&module.position);
+    module.in_sync = true;
+    update_entry();
+    move_entry_reset(&module.entry);
+
+    servo_init(SERVO_PIN);
+    buzz_player_init();
+
+    brain_queue_init(&module.brain_messages);
+    brain_queue_register(&module.brain_messages, "hand.brain");
+
+    jnxu_init(transport_bt_init(BT_MODE, BT_MAC));
+    for (uintptr_t i = 0; i < sizeof(BRAIN_HANDLERS) / sizeof(*BRAIN_HANDLERS); i++)
+        jnxu_register_handler(BRAIN_HANDLERS[i].cmd, queue_brain_message, (void *)i);
+
+    evloop_add("encoder", encoder_ready, handle_encoder, NULL, HAND_ENCODER_BUDGET_USEC);
+    evloop_add("brain", brain_message_ready, handle_brain_message, NULL, HAND_BRAIN_BUDGET_USEC);
+    evloop_add("reports", report_ready, send_reports, NULL, HAND_LINK_BUDGET_USEC);
+    module.mirror_task = evloop_add_timer("mirror", send_mirror, NULL, HAND_LINK_BUDGET_USEC);
+    evloop_add_periodic("stats", HAND_STATS_USEC, print_stats, NULL, HAND_STATS_USEC);
+    evloop_run();
+}
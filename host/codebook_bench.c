@@ -0,0 +1,196 @@
+/*
+ * Expected delivery time of each haptic codebook (see codebook.h) over a
+ * corpus of games. Build with `make host`.
+ *
+ * Usage: ./codebook_bench [-w] [corpus files...]
+ *
+ * The corpus is read from the files given (or stdin), one game per line, as
+ * moves in UCI notation separated by spaces, starting with white's move (like
+ * games.txt, which engine.py writes). Every move is encoded from the side of
+ * the player making it, as the hand would buzz it to them.
+ *
+ * The "index" row is the move as its index among the legal moves (see
+ * codebook_encode_index), which needs the game to be replayed from the start:
+ * once a move of a game is not legal, the rest of that game counts as failed.
+ *
+ * With -w, it also prints the frequency of every value of the fields of the
+ * prefix code, ready to paste into PREFIX_WEIGHTS in codebook.c.
+ */
+#include "chess_commands.h"
+#include "codebook.h"
+#include "movegen.h"
+#include "servo.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_LINE 8192
+#define MAX_CODEBOOKS 8
+
+typedef struct {
+    unsigned long moves;
+    double total_sec;
+    double max_sec;
+    unsigned long buzzes;
+    unsigned long failed;   // did not fit in CODEBOOK_MAX_SYMBOLS
+} result_t;
+
+static result_t results[MAX_CODEBOOKS];
+static result_t index_result;
+static unsigned long weights[4][15];
+
+/*
+ * How long the hand takes to play a sequence: the servo ends buzzes at the end
+ * of a pulse period.
+ */
+static double delivery_sec(const uint8_t *symbols, size_t n, unsigned long *buzzes) {
+    unsigned long usec = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        unsigned long d = codebook_symbol_usec(symbols[i]);
+        if (codebook_symbol_is_buzz(symbols[i])) {
+            d = (d + SERVO_PERIOD_USEC - 1) / SERVO_PERIOD_USEC * SERVO_PERIOD_USEC;
+            (*buzzes)++;
+        }
+        usec += d;
+    }
+
+    return usec / 1e6;
+}
+
+static void add_result(result_t *r, const uint8_t *symbols, size_t n) {
+    if (n == 0) {
+        r->failed++;
+        return;
+    }
+
+    double sec = delivery_sec(symbols, n, &r->buzzes);
+    r->moves++;
+    r->total_sec += sec;
+    if (sec > r->max_sec)
+        r->max_sec = sec;
+}
+
+/*
+ * Adds a move of the game being replayed in `pos` to the "index" row.
+ *
+ * @return          `false` if the move is not legal
+ */
+static bool add_index(movegen_position_t *pos, const char *uci) {
+    movegen_move_t move;
+    int index = movegen_find(pos, uci, &move, NULL);
+    if (index < 0)
+        return false;
+
+    uint8_t symbols[CODEBOOK_MAX_SYMBOLS];
+    add_result(&index_result, symbols, codebook_encode_index(index, symbols, sizeof(symbols)));
+    movegen_apply(pos, &move);
+    return true;
+}
+
+static void add_move(const char *uci, int side) {
+    codebook_move_t move;
+    if (!codebook_parse_move(uci, side, &move))
+        return;
+
+    weights[0][move.col0]++;
+    weights[1][move.row0]++;
+    weights[2][move.col1 - move.col0 + 7]++;
+    weights[3][move.row1 - move.row0 + 7]++;
+
+    const codebook_t *codebook;
+    for (size_t i = 0; (codebook = codebook_get(i)) != NULL && i < MAX_CODEBOOKS; i++) {
+        uint8_t symbols[CODEBOOK_MAX_SYMBOLS];
+        add_result(&results[i], symbols, codebook->encode(&move, symbols, sizeof(symbols)));
+    }
+}
+
+static void read_corpus(FILE *f) {
+    char line[MAX_LINE];
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        int ply = 0;
+        movegen_position_t pos;
+        bool replaying = true;
+        movegen_init(&pos);
+
+        for (char *move = strtok(line, " \t\r\n"); move != NULL; move = strtok(NULL, " \t\r\n")) {
+            if (strlen(move) < 4 || strlen(move) > 5)
+                continue;
+            add_move(move, ply % 2 == 0 ? WHITE : BLACK);
+            if (replaying)
+                replaying = add_index(&pos, move);
+            if (!replaying)
+                index_result.failed++;
+            ply++;
+        }
+    }
+}
+
+static void print_result(const char *name, const result_t *r) {
+    printf("%-10s %8lu %10.2f %10.2f %12.2f %8lu\n", name, r->moves,
+            r->moves ? r->total_sec / r->moves : 0, r->max_sec,
+            r->moves ? (double)r->buzzes / r->moves : 0, r->failed);
+}
+
+static void print_weights(void) {
+    static const char *FIELDS[] = {
+        "from file, a to h", "from rank, 1 to 8", "file delta, -7 to 7", "rank delta, -7 to 7",
+    };
+    static const int VALUES[] = { 8, 8, 15, 15 };
+
+    printf("\nstatic const unsigned PREFIX_WEIGHTS[PREFIX_FIELDS][PREFIX_MAX_VALUES] = {\n");
+    for (int field = 0; field < 4; field++) {
+        printf("    // %s\n    {", FIELDS[field]);
+        for (int v = 0; v < VALUES[field]; v++)
+            printf(" %lu%s", weights[field][v], v + 1 < VALUES[field] ? "," : "");
+        printf(" },\n");
+    }
+    printf("};\n");
+}
+
+int main(int argc, char *argv[]) {
+    bool print = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w")) != -1) {
+        switch (opt) {
+            case 'w': print = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-w] [corpus files...]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind == argc) {
+        read_corpus(stdin);
+    } else {
+        for (int i = optind; i < argc; i++) {
+            FILE *f = fopen(argv[i], "r");
+            if (f == NULL) {
+                perror(argv[i]);
+                return 1;
+            }
+            read_corpus(f);
+            fclose(f);
+        }
+    }
+
+    if (results[0].moves == 0) {
+        fprintf(stderr, "no moves in the corpus\n");
+        return 1;
+    }
+
+    printf("%-10s %8s %10s %10s %12s %8s\n",
+            "codebook", "moves", "mean s", "max s", "buzzes/move", "failed");
+
+    const codebook_t *codebook;
+    for (size_t i = 0; (codebook = codebook_get(i)) != NULL && i < MAX_CODEBOOKS; i++)
+        print_result(codebook->name, &results[i]);
+    print_result("index", &index_result);
+
+    if (print)
+        print_weights();
+
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef HOST_GPIO_H
+#define HOST_GPIO_H
+
+/*
+ * Host replacement for the gpio module of libmango. Pins are simulated by
+ * host/sim.c, which lets a program drive input levels (see host/sim.h).
+ */
+
+#include <stdbool.h>
+
+typedef enum {
+    GPIO_PB0 = 0x100,
+    GPIO_PB1,
+    GPIO_PD21 = 0x315,
+    GPIO_PD22,
+} gpio_id_t;
+
+void gpio_init(void);
+void gpio_set_input(gpio_id_t pin);
+void gpio_set_output(gpio_id_t pin);
+void gpio_write(gpio_id_t pin, int value);
+int gpio_read(gpio_id_t pin);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef HOST_GPIO_EXTRA_H
+#define HOST_GPIO_EXTRA_H
+
+/*
+ * Host replacement for the gpio_extra module of libmango. Simulated pins read
+ * high until driven, as if they had pull-ups, so both calls do nothing.
+ */
+
+#include "gpio.h"
+
+void gpio_set_pullup(gpio_id_t pin);
+void gpio_set_pulldown(gpio_id_t pin);
+
+#endif
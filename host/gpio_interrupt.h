@@ -0,0 +1,27 @@
+#ifndef HOST_GPIO_INTERRUPT_H
+#define HOST_GPIO_INTERRUPT_H
+
+/*
+ * Host replacement for the gpio_interrupt module of libmango, on top of the
+ * simulated pins and interrupt controller of host/sim.c.
+ */
+
+#include "gpio.h"
+#include "interrupts.h"
+
+typedef enum {
+    GPIO_INTERRUPT_POSITIVE_EDGE,
+    GPIO_INTERRUPT_NEGATIVE_EDGE,
+    GPIO_INTERRUPT_HIGH_LEVEL,
+    GPIO_INTERRUPT_LOW_LEVEL,
+    GPIO_INTERRUPT_DOUBLE_EDGE,
+} gpio_event_t;
+
+void gpio_interrupt_init(void);
+void gpio_interrupt_config(gpio_id_t pin, gpio_event_t event, bool debounce);
+void gpio_interrupt_enable(gpio_id_t pin);
+void gpio_interrupt_disable(gpio_id_t pin);
+void gpio_interrupt_clear(gpio_id_t pin);
+void gpio_interrupt_register_handler(gpio_id_t pin, handlerfn_t fn, void *aux_data);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef HOST_HSTIMER_H
+#define HOST_HSTIMER_H
+
+/*
+ * Host replacement for the hstimer module of libmango. The timers count
+ * simulated time (see host/sim.h) and raise their interrupt periodically.
+ */
+
+typedef enum {
+    HSTIMER0 = 0,
+    HSTIMER1,
+} hstimer_id_t;
+
+void hstimer_init(hstimer_id_t index, long usec_interval);
+void hstimer_enable(hstimer_id_t index);
+void hstimer_disable(hstimer_id_t index);
+void hstimer_interrupt_clear(hstimer_id_t index);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef HOST_INTERRUPTS_H
+#define HOST_INTERRUPTS_H
+
+/*
+ * Host replacement for the interrupts module of libmango. host/sim.c delivers
+ * the simulated interrupts, one at a time, as on the Mango Pi.
+ */
+
+#include <stdint.h>
+
+typedef enum {
+    INTERRUPT_SOURCE_UART0 = 18,
+    INTERRUPT_SOURCE_HSTIMER0 = 71,
+    INTERRUPT_SOURCE_HSTIMER1 = 72,
+} interrupt_source_t;
+
+typedef void (*handlerfn_t)(uintptr_t pc, void *aux_data);
+
+void interrupts_init(void);
+void interrupts_global_enable(void);
+void interrupts_global_disable(void);
+void interrupts_enable_source(interrupt_source_t source);
+void interrupts_disable_source(interrupt_source_t source);
+void interrupts_register_handler(interrupt_source_t source, handlerfn_t fn, void *aux_data);
+
+#endif
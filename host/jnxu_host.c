@@ -0,0 +1,137 @@
+/*
+ * Runs the JNXU protocol on a Linux host to measure its throughput and
+ * latency without any hardware. Build with `make host`.
+ *
+ * Usage:
+ *   ./jnxu_host loopback [count]   protocol sends to itself, in memory
+ *   ./jnxu_host serve [path]       echoes every message back over a pty
+ *                                  (creates one and prints its path if no path)
+ *   ./jnxu_host bench path [count] sends messages to `serve` over the pty at
+ *                                  `path` and measures the round trip
+ */
+#include "jnxu.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CMD_DATA        1
+#define PAYLOAD_LEN     64
+#define DEFAULT_COUNT   100000
+
+static struct {
+    unsigned long received;
+    unsigned long bytes;
+    unsigned long total_latency;
+    unsigned long max_latency;
+} stats;
+
+/*
+ * Fills the payload with the current time followed by a pattern which
+ * includes bytes that have to be escaped or stuffed.
+ */
+static void make_payload(uint8_t *buf, size_t len) {
+    static const uint8_t PATTERN[] = { 'A', 'T', '&', 'O', 'K', '&', '_', 0 };
+    unsigned long now = timer_get_ticks();
+    memcpy(buf, &now, sizeof(now));
+    for (size_t i = sizeof(now); i < len; i++) {
+        buf[i] = PATTERN[i % sizeof(PATTERN)];
+    }
+}
+
+static void count_handler(void *aux_data, const uint8_t *message, size_t len) {
+    unsigned long sent;
+    memcpy(&sent, message, sizeof(sent));
+
+    unsigned long latency = timer_get_ticks() - sent;
+    stats.received++;
+    stats.bytes += len;
+    stats.total_latency += latency;
+    if (latency > stats.max_latency)
+        stats.max_latency = latency;
+}
+
+static void echo_handler(void *aux_data, const uint8_t *message, size_t len) {
+    jnxu_send(CMD_DATA, message, len);
+}
+
+static void report(unsigned long start, unsigned long sent) {
+    double secs = (double)(timer_get_ticks() - start) / (TICKS_PER_USEC * 1e6);
+    printf("sent %lu, received %lu in %.3f s\n", sent, stats.received, secs);
+    if (stats.received == 0)
+        return;
+    printf("%.0f msgs/s, %.2f MB/s payload\n",
+            stats.received / secs, stats.bytes / secs / 1e6);
+    printf("latency: avg %.2f us, max %.2f us\n",
+            (double)stats.total_latency / stats.received / TICKS_PER_USEC,
+            (double)stats.max_latency / TICKS_PER_USEC);
+}
+
+static void run_loopback(unsigned long count) {
+    jnxu_init(transport_loopback_init());
+    jnxu_register_handler(CMD_DATA, count_handler, NULL);
+
+    uint8_t payload[PAYLOAD_LEN];
+    unsigned long failed = 0;
+    unsigned long start = timer_get_ticks();
+    for (unsigned long i = 0; i < count; i++) {
+        make_payload(payload, sizeof(payload));
+        if (!jnxu_send(CMD_DATA, payload, sizeof(payload)))
+            failed++;
+        jnxu_poll();
+    }
+    report(start, count);
+    if (failed > 0)
+        printf("%lu sends truncated by the transport\n", failed);
+}
+
+static void run_serve(const char *path) {
+    const transport_t *t = transport_pty_init(path);
+    if (t == NULL) {
+        perror("pty");
+        exit(1);
+    }
+    jnxu_init(t);
+    jnxu_register_handler(CMD_DATA, echo_handler, NULL);
+    while (1) {
+        jnxu_poll();
+    }
+}
+
+static void run_bench(const char *path, unsigned long count) {
+    const transport_t *t = transport_pty_init(path);
+    if (t == NULL) {
+        perror("pty");
+        exit(1);
+    }
+    jnxu_init(t);
+    jnxu_register_handler(CMD_DATA, count_handler, NULL);
+
+    uint8_t payload[PAYLOAD_LEN];
+    unsigned long start = timer_get_ticks();
+    for (unsigned long i = 0; i < count; i++) {
+        make_payload(payload, sizeof(payload));
+        jnxu_send(CMD_DATA, payload, sizeof(payload));
+
+        // wait for the echo (round trip), giving up after a second
+        unsigned long deadline = timer_get_ticks() + 1000 * 1000 * TICKS_PER_USEC;
+        while (stats.received <= i && timer_get_ticks() < deadline) {
+            jnxu_poll();
+        }
+    }
+    report(start, count);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "loopback") == 0) {
+        run_loopback(argc >= 3 ? strtoul(argv[2], NULL, 10) : DEFAULT_COUNT);
+    } else if (argc >= 2 && strcmp(argv[1], "serve") == 0) {
+        run_serve(argc >= 3 ? argv[2] : NULL);
+    } else if (argc >= 3 && strcmp(argv[1], "bench") == 0) {
+        run_bench(argv[2], argc >= 4 ? strtoul(argv[3], NULL, 10) : DEFAULT_COUNT / 10);
+    } else {
+        fprintf(stderr, "usage: %s loopback [count] | serve [path] | bench path [count]\n", argv[0]);
+        return 1;
+    }
+    return 0;
+}
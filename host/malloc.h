@@ -0,0 +1,10 @@
+#ifndef HOST_MALLOC_H
+#define HOST_MALLOC_H
+
+/*
+ * Host replacement for the malloc module of libmango.
+ */
+
+#include <stdlib.h>
+
+#endif
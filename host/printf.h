@@ -0,0 +1,10 @@
+#ifndef HOST_PRINTF_H
+#define HOST_PRINTF_H
+
+/*
+ * Host replacement for the printf module of libmango.
+ */
+
+#include <stdio.h>
+
+#endif
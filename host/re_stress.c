@@ -0,0 +1,227 @@
+/*
+ * Stress test of the rotary encoder driver (re.c) on simulated pins (see
+ * host/sim.h). Build with `make host`.
+ *
+ * Usage: ./re_stress [-b bounces] [-w bounce window usec] [-j jitter]
+ *                    [-l interrupt latency usec] [-i handler usec] [-s seed]
+ *
+ * For a range of rotation speeds, replays bursts of detents in alternating
+ * directions as quadrature waveforms, with contact bounce after every edge
+ * and random jitter in the timing of the edges, and compares what the driver
+ * reports with what was turned: detents missed, extra detents, detents in the
+ * wrong direction and bursts whose RE_EVENT_GESTUREs do not add up. It also
+ * reports how many interrupts each detent costs and the (real) time spent in
+ * the handlers, so changes to the input path can be compared.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "interrupts.h"
+#include "re.h"
+#include "sim.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define RE_CLOCK GPIO_PB0
+#define RE_DATA GPIO_PD22
+#define RE_SW GPIO_PD21
+
+#define TICKS_PER_SECOND (1000UL * 1000 * TICKS_PER_USEC)
+
+#define DETENTS_PER_BURST 24
+#define BURSTS 40
+
+// long enough for the gesture timeout and the acceleration to reset
+#define PAUSE_USEC (200 * 1000)
+
+static const int RATES[] = { 20, 50, 100, 200, 400, 800, 1600, 3200 };
+
+static struct {
+    int bounces;            // bounces after every edge
+    unsigned long window;   // ticks the bounces last, at most
+    double jitter;          // fraction of the time between edges
+
+    re_device_t *re;
+    unsigned long seed;
+} config = {
+    .bounces = 3,
+    .window = 200 * TICKS_PER_USEC,
+    .jitter = 0.3,
+    .seed = 1,
+};
+
+typedef struct {
+    unsigned long detents;
+    unsigned long missed;
+    unsigned long extra;
+    unsigned long misdirected;
+    unsigned long gesture_errors;
+} result_t;
+
+/*
+ * Uniform in [0, 1), reproducible for a given seed (xorshift).
+ */
+static double uniform(void) {
+    config.seed ^= config.seed << 13;
+    config.seed ^= config.seed >> 7;
+    config.seed ^= config.seed << 17;
+    return (config.seed >> 11) * (1.0 / (1UL << 53));
+}
+
+/*
+ * Drives one channel to `level` at time `t`, followed by contact bounce which
+ * lasts less than `max_window` ticks.
+ */
+static void edge(gpio_id_t pin, int level, unsigned long t, unsigned long max_window) {
+    sim_run_until(t);
+    sim_drive(pin, level);
+
+    unsigned long window = config.window < max_window ? config.window : max_window;
+    if (config.bounces == 0 || window == 0)
+        return;
+
+    unsigned long slot = window / (2 * config.bounces);
+    for (int i = 0; i < config.bounces; i++) {
+        t += 1 + (unsigned long)(slot * uniform());
+        sim_run_until(t);
+        sim_drive(pin, !level);
+
+        t += 1 + (unsigned long)(slot * uniform());
+        sim_run_until(t);
+        sim_drive(pin, level);
+    }
+}
+
+/*
+ * Turns `n` detents in `direction` (+1 clockwise) at `rate` detents per second,
+ * starting now. Returns when the last edge has been driven.
+ */
+static void turn(int direction, int n, int rate) {
+    // (clock, data) after each quarter step, clockwise: data leads
+    static const int CW[4][2] = { {1, 0}, {0, 0}, {0, 1}, {1, 1} };
+    static const int CCW[4][2] = { {0, 1}, {0, 0}, {1, 0}, {1, 1} };
+    const int (*steps)[2] = direction > 0 ? CW : CCW;
+
+    double quarter = (double)TICKS_PER_SECOND / rate / 4;
+    unsigned long max_window = quarter * (1 - config.jitter) / 2;
+    unsigned long t = sim_now();
+    int clock = 1, data = 1;
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < 4; j++) {
+            t += quarter * (1 + config.jitter * (2 * uniform() - 1));
+
+            if (steps[j][0] != clock) {
+                clock = steps[j][0];
+                edge(RE_CLOCK, clock, t, max_window);
+            } else {
+                data = steps[j][1];
+                edge(RE_DATA, data, t, max_window);
+            }
+        }
+    }
+}
+
+/*
+ * Reads everything the driver reported for a burst and checks it against the
+ * detents that were turned.
+ */
+static void check_burst(int direction, int n, result_t *result) {
+    int right = 0, wrong = 0, steps = 0, gesture_steps = 0, gestures = 0;
+    re_event_t event;
+
+    while (re_read(config.re, &event)) {
+        switch (event.type) {
+            case RE_EVENT_CLOCKWISE:
+            case RE_EVENT_COUNTERCLOCKWISE:
+                if ((event.type == RE_EVENT_CLOCKWISE) == (direction > 0))
+                    right++;
+                else
+                    wrong++;
+                steps += event.steps;
+                break;
+
+            case RE_EVENT_GESTURE:
+                // slow turns may pause longer than the timeout, which splits
+                // the burst, but the gestures must still add up
+                gestures++;
+                gesture_steps += event.steps;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    if (gestures == 0 || gesture_steps != steps)
+        result->gesture_errors++;
+
+    result->detents += n;
+    if (right < n)
+        result->missed += n - right;
+    else
+        result->extra += right - n;
+    result->misdirected += wrong;
+}
+
+static void run(int rate) {
+    result_t result = { 0 };
+    sim_clear_stats();
+
+    for (int i = 0; i < BURSTS; i++) {
+        int direction = i % 2 ? -1 : 1;
+        turn(direction, DETENTS_PER_BURST, rate);
+        sim_run_until(sim_now() + PAUSE_USEC * TICKS_PER_USEC);
+        check_burst(direction, DETENTS_PER_BURST, &result);
+    }
+
+    const sim_stats_t *stats = sim_stats();
+    printf("%6d %8lu %7lu %7lu %7lu %8lu %8.2f %9lu %7.0f %7lu\n",
+            rate, result.detents, result.missed, result.extra,
+            result.misdirected, result.gesture_errors,
+            (double)stats->gpio_calls / result.detents, stats->coalesced,
+            (double)stats->gpio_ns / stats->gpio_calls, stats->gpio_max_ns);
+}
+
+int main(int argc, char *argv[]) {
+    double latency_usec = 2;
+    double isr_usec = 3;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:w:j:l:i:s:")) != -1) {
+        switch (opt) {
+            case 'b': config.bounces = atoi(optarg); break;
+            case 'w': config.window = atof(optarg) * TICKS_PER_USEC; break;
+            case 'j': config.jitter = atof(optarg); break;
+            case 'l': latency_usec = atof(optarg); break;
+            case 'i': isr_usec = atof(optarg); break;
+            case 's': config.seed = strtoul(optarg, NULL, 0) | 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-b bounces] [-w window usec] [-j jitter] "
+                        "[-l latency usec] [-i isr usec] [-s seed]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (config.jitter < 0 || config.jitter >= 1) {
+        fprintf(stderr, "jitter must be in [0, 1)\n");
+        return 1;
+    }
+
+    sim_init(latency_usec * TICKS_PER_USEC, isr_usec * TICKS_PER_USEC);
+    interrupts_init();
+    interrupts_global_enable();
+    config.re = re_new(RE_CLOCK, RE_DATA, RE_SW);
+
+    printf("%d bounces in %.0f us, jitter %.0f%%, latency %.1f us, handler %.1f us\n",
+            config.bounces, (double)config.window / TICKS_PER_USEC,
+            config.jitter * 100, latency_usec, isr_usec);
+    printf("%6s %8s %7s %7s %7s %8s %8s %9s %7s %7s\n",
+            "det/s", "detents", "missed", "extra", "wrong", "gesture",
+            "irq/det", "coalesced", "ns/irq", "max ns");
+
+    for (int i = 0; i < sizeof(RATES) / sizeof(*RATES); i++)
+        run(RATES[i]);
+
+    return 0;
+}
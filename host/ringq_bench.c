@@ -0,0 +1,154 @@
+/*
+ * Measures ringq operations per second on a host. Build with `make host`.
+ *
+ * Usage: ./ringq_bench [millions of operations] [producer threads]
+ *
+ * The multi-producer run also checks that no element is lost, duplicated or
+ * reordered (per producer), since that is the whole point of the MPSC queue.
+ */
+#include "ringq.h"
+#include "timer.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BULK 32
+#define MAX_PRODUCERS 16
+
+RINGQ_DECLARE(bench_queue, uint32_t, 512)
+RINGQ_MPSC_DECLARE(bench_mpsc, uint32_t, 512)
+
+static bench_queue_t queue;
+static bench_mpsc_t mpsc;
+static unsigned long count;
+static int nproducers;
+
+static double seconds_since(unsigned long start) {
+    return (double)(timer_get_ticks() - start) / (TICKS_PER_USEC * 1e6);
+}
+
+static void report(const char *name, unsigned long ops, unsigned long start) {
+    double secs = seconds_since(start);
+    printf("%-24s %8.1f M ops/s\n", name, ops / secs / 1e6);
+}
+
+static void bench_single(void) {
+    bench_queue_init(&queue);
+    uint32_t sum = 0, elem = 0;
+
+    unsigned long start = timer_get_ticks();
+    for (unsigned long i = 0; i < count; i++) {
+        bench_queue_enqueue(&queue, i);
+        bench_queue_dequeue(&queue, &elem);
+        sum += elem;
+    }
+    report("enqueue+dequeue", 2 * count, start);
+
+    uint32_t in[BULK], out[BULK];
+    for (int i = 0; i < BULK; i++) in[i] = i;
+
+    start = timer_get_ticks();
+    for (unsigned long i = 0; i < count / BULK; i++) {
+        bench_queue_enqueue_bulk(&queue, in, BULK);
+        bench_queue_dequeue_bulk(&queue, out, BULK);
+        sum += out[0];
+    }
+    report("bulk enqueue+dequeue", 2 * (count / BULK) * BULK, start);
+
+    // keep the compiler from optimizing the loops away
+    if (sum == 42) printf("\n");
+}
+
+static void *producer(void *arg) {
+    for (unsigned long i = 0; i < count; i++) {
+        while (!bench_queue_enqueue(&queue, i)) sched_yield();
+    }
+    return NULL;
+}
+
+static void bench_threads(void) {
+    bench_queue_init(&queue);
+    pthread_t thread;
+
+    unsigned long start = timer_get_ticks();
+    pthread_create(&thread, NULL, producer, NULL);
+
+    unsigned long errors = 0;
+    for (unsigned long i = 0; i < count; i++) {
+        uint32_t elem;
+        while (!bench_queue_dequeue(&queue, &elem)) sched_yield();
+        if (elem != (uint32_t)i) errors++;
+    }
+    pthread_join(thread, NULL);
+
+    report("spsc, two threads", count, start);
+    if (errors > 0)
+        printf("%lu elements out of order!\n", errors);
+}
+
+/*
+ * Each element is the producer id in the top byte and a sequence number in
+ * the rest, so that the consumer can check the stream of every producer.
+ */
+static void *mpsc_producer(void *arg) {
+    uint32_t id = (uintptr_t)arg;
+    unsigned long n = count / nproducers;
+    for (unsigned long i = 0; i < n; i++) {
+        while (!bench_mpsc_enqueue(&mpsc, (id << 24) | (i & 0xffffff))) sched_yield();
+    }
+    return NULL;
+}
+
+static void bench_mpsc_threads(void) {
+    bench_mpsc_init(&mpsc);
+    pthread_t threads[MAX_PRODUCERS];
+    uint32_t expected[MAX_PRODUCERS] = { 0 };
+
+    unsigned long start = timer_get_ticks();
+    for (int i = 0; i < nproducers; i++) {
+        pthread_create(&threads[i], NULL, mpsc_producer, (void *)(uintptr_t)i);
+    }
+
+    unsigned long errors = 0;
+    unsigned long total = (count / nproducers) * nproducers;
+    for (unsigned long i = 0; i < total; i++) {
+        uint32_t elem;
+        while (!bench_mpsc_dequeue(&mpsc, &elem)) sched_yield();
+
+        uint32_t id = elem >> 24;
+        if (id >= nproducers || (elem & 0xffffff) != expected[id]) {
+            errors++;
+        } else {
+            expected[id] = (expected[id] + 1) & 0xffffff;
+        }
+    }
+    for (int i = 0; i < nproducers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "mpsc, %d producers", nproducers);
+    report(name, total, start);
+    printf("%lu elements lost, duplicated or out of order\n", errors);
+    if (!bench_mpsc_empty(&mpsc))
+        printf("queue not empty at the end!\n");
+}
+
+int main(int argc, char *argv[]) {
+    count = (argc > 1 ? strtoul(argv[1], NULL, 10) : 50) * 1000 * 1000;
+    nproducers = argc > 2 ? atoi(argv[2]) : 4;
+    if (nproducers < 1 || nproducers > MAX_PRODUCERS) {
+        fprintf(stderr, "producers must be between 1 and %d\n", MAX_PRODUCERS);
+        return 1;
+    }
+    bench_single();
+    bench_threads();
+    bench_mpsc_threads();
+
+    printf("\n");
+    bench_queue_register(&queue, "spsc");
+    bench_mpsc_register(&mpsc, "mpsc");
+    ringq_dump();
+    return 0;
+}
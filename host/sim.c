@@ -0,0 +1,323 @@
+/*
+ * Simulated Mango Pi peripherals on a simulated clock (see host/sim.h).
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "sim.h"
+#include "gpio_extra.h"
+#include "gpio_interrupt.h"
+#include "hstimer.h"
+#include "interrupts.h"
+#include "timer.h"
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_PINS 16
+#define NUM_HSTIMERS 2
+
+typedef struct {
+    gpio_id_t id;
+    int level;
+    gpio_event_t event;
+    bool enabled;
+    bool pending;
+    unsigned long pending_since;
+    handlerfn_t fn;
+    void *aux_data;
+} pin_t;
+
+typedef struct {
+    unsigned long interval;     // ticks
+    unsigned long deadline;
+    bool enabled;
+    bool source_enabled;
+    handlerfn_t fn;
+    void *aux_data;
+} hstimer_t;
+
+static struct {
+    unsigned long now;
+    unsigned long cpu_free;     // the running handler ends here
+    unsigned long latency;
+    unsigned long isr;
+    bool interrupts_enabled;
+
+    pin_t pins[MAX_PINS];
+    int npins;
+    hstimer_t timers[NUM_HSTIMERS];
+
+    sim_stats_t stats;
+} module;
+
+static unsigned long real_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/*
+ * Finds the state of a pin, adding it the first time it is used. Unused pins
+ * read high (pulled up).
+ */
+static pin_t *find_pin(gpio_id_t id) {
+    for (int i = 0; i < module.npins; i++) {
+        if (module.pins[i].id == id)
+            return &module.pins[i];
+    }
+
+    if (module.npins == MAX_PINS)
+        return NULL;
+
+    pin_t *pin = &module.pins[module.npins++];
+    memset(pin, 0, sizeof(*pin));
+    pin->id = id;
+    pin->level = 1;
+    return pin;
+}
+
+static bool edge_matches(gpio_event_t event, int from, int to) {
+    switch (event) {
+        case GPIO_INTERRUPT_POSITIVE_EDGE: return from == 0 && to == 1;
+        case GPIO_INTERRUPT_NEGATIVE_EDGE: return from == 1 && to == 0;
+        case GPIO_INTERRUPT_DOUBLE_EDGE:   return true;
+        default:                           return false;
+    }
+}
+
+static unsigned long max(unsigned long a, unsigned long b) {
+    return a > b ? a : b;
+}
+
+void sim_init(unsigned long latency_ticks, unsigned long isr_ticks) {
+    memset(&module, 0, sizeof(module));
+    module.latency = latency_ticks;
+    module.isr = isr_ticks;
+}
+
+void sim_drive(gpio_id_t id, int level) {
+    pin_t *pin = find_pin(id);
+    if (pin == NULL || pin->level == level)
+        return;
+
+    module.stats.edges++;
+
+    if (edge_matches(pin->event, pin->level, level)) {
+        if (pin->pending) {
+            module.stats.coalesced++;
+        } else {
+            pin->pending = true;
+            pin->pending_since = module.now;
+        }
+    }
+
+    pin->level = level;
+}
+
+void sim_run_until(unsigned long ticks) {
+    while (module.interrupts_enabled) {
+        // the next interrupt to be delivered, if any
+        unsigned long when = (unsigned long)-1;
+        pin_t *next_pin = NULL;
+        hstimer_t *next_timer = NULL;
+
+        for (int i = 0; i < module.npins; i++) {
+            pin_t *pin = &module.pins[i];
+            if (!pin->pending || !pin->enabled || pin->fn == NULL)
+                continue;
+
+            unsigned long t = max(pin->pending_since + module.latency, module.cpu_free);
+            if (t < when) {
+                when = t;
+                next_pin = pin;
+            }
+        }
+
+        for (int i = 0; i < NUM_HSTIMERS; i++) {
+            hstimer_t *timer = &module.timers[i];
+            if (!timer->enabled || !timer->source_enabled || timer->fn == NULL)
+                continue;
+
+            unsigned long t = max(timer->deadline + module.latency, module.cpu_free);
+            if (t < when) {
+                when = t;
+                next_pin = NULL;
+                next_timer = timer;
+            }
+        }
+
+        if (when > ticks)
+            break;
+
+        module.now = when;
+
+        if (next_timer != NULL) {
+            // periodic, reloads by itself (the handler may change that)
+            next_timer->deadline += next_timer->interval;
+            module.stats.timer_calls++;
+            next_timer->fn(0, next_timer->aux_data);
+        } else {
+            unsigned long start = real_ns();
+            next_pin->fn(0, next_pin->aux_data);
+            unsigned long ns = real_ns() - start;
+
+            module.stats.gpio_calls++;
+            module.stats.gpio_ns += ns;
+            if (ns > module.stats.gpio_max_ns)
+                module.stats.gpio_max_ns = ns;
+        }
+
+        module.cpu_free = module.now + module.isr;
+    }
+
+    if (ticks > module.now)
+        module.now = ticks;
+}
+
+unsigned long sim_now(void) {
+    return module.now;
+}
+
+const sim_stats_t *sim_stats(void) {
+    return &module.stats;
+}
+
+void sim_clear_stats(void) {
+    memset(&module.stats, 0, sizeof(module.stats));
+}
+
+// timer
+
+unsigned long timer_get_ticks(void) {
+    return module.now;
+}
+
+void timer_delay_us(int usec) {
+    sim_run_until(module.now + (unsigned long)usec * TICKS_PER_USEC);
+}
+
+void timer_delay_ms(int msec) {
+    timer_delay_us(1000 * msec);
+}
+
+void timer_delay(int secs) {
+    timer_delay_us(1000 * 1000 * secs);
+}
+
+// gpio
+
+void gpio_init(void) {}
+
+void gpio_set_input(gpio_id_t id) {
+    find_pin(id);
+}
+
+void gpio_set_output(gpio_id_t id) {
+    find_pin(id);
+}
+
+void gpio_write(gpio_id_t id, int value) {
+    sim_drive(id, value != 0);
+}
+
+int gpio_read(gpio_id_t id) {
+    pin_t *pin = find_pin(id);
+    return pin == NULL ? 1 : pin->level;
+}
+
+void gpio_set_pullup(gpio_id_t id) {}
+
+void gpio_set_pulldown(gpio_id_t id) {}
+
+// gpio interrupts
+
+void gpio_interrupt_init(void) {}
+
+void gpio_interrupt_config(gpio_id_t id, gpio_event_t event, bool debounce) {
+    pin_t *pin = find_pin(id);
+    if (pin != NULL)
+        pin->event = event;
+}
+
+void gpio_interrupt_enable(gpio_id_t id) {
+    pin_t *pin = find_pin(id);
+    if (pin != NULL)
+        pin->enabled = true;
+}
+
+void gpio_interrupt_disable(gpio_id_t id) {
+    pin_t *pin = find_pin(id);
+    if (pin != NULL)
+        pin->enabled = false;
+}
+
+void gpio_interrupt_clear(gpio_id_t id) {
+    pin_t *pin = find_pin(id);
+    if (pin != NULL)
+        pin->pending = false;
+}
+
+void gpio_interrupt_register_handler(gpio_id_t id, handlerfn_t fn, void *aux_data) {
+    pin_t *pin = find_pin(id);
+    if (pin != NULL) {
+        pin->fn = fn;
+        pin->aux_data = aux_data;
+    }
+}
+
+// interrupt controller
+
+static hstimer_t *source_timer(interrupt_source_t source) {
+    switch (source) {
+        case INTERRUPT_SOURCE_HSTIMER0: return &module.timers[HSTIMER0];
+        case INTERRUPT_SOURCE_HSTIMER1: return &module.timers[HSTIMER1];
+        default:                        return NULL;
+    }
+}
+
+void interrupts_init(void) {}
+
+void interrupts_global_enable(void) {
+    module.interrupts_enabled = true;
+}
+
+void interrupts_global_disable(void) {
+    module.interrupts_enabled = false;
+}
+
+void interrupts_enable_source(interrupt_source_t source) {
+    hstimer_t *timer = source_timer(source);
+    if (timer != NULL)
+        timer->source_enabled = true;
+}
+
+void interrupts_disable_source(interrupt_source_t source) {
+    hstimer_t *timer = source_timer(source);
+    if (timer != NULL)
+        timer->source_enabled = false;
+}
+
+void interrupts_register_handler(interrupt_source_t source, handlerfn_t fn, void *aux_data) {
+    hstimer_t *timer = source_timer(source);
+    if (timer != NULL) {
+        timer->fn = fn;
+        timer->aux_data = aux_data;
+    }
+}
+
+// high speed timers
+
+void hstimer_init(hstimer_id_t index, long usec_interval) {
+    module.timers[index].interval = usec_interval * TICKS_PER_USEC;
+    module.timers[index].enabled = false;
+}
+
+void hstimer_enable(hstimer_id_t index) {
+    module.timers[index].deadline = module.now + module.timers[index].interval;
+    module.timers[index].enabled = true;
+}
+
+void hstimer_disable(hstimer_id_t index) {
+    module.timers[index].enabled = false;
+}
+
+void hstimer_interrupt_clear(hstimer_id_t index) {}
@@ -0,0 +1,70 @@
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+/*
+ * Simulated Mango Pi peripherals for host programs: GPIO pins, GPIO
+ * interrupts, the high speed timers and the system timer, all running on a
+ * simulated clock. It implements host/gpio.h, host/gpio_extra.h,
+ * host/gpio_interrupt.h, host/interrupts.h, host/hstimer.h and host/timer.h,
+ * so a driver such as re.c builds unmodified on top of it (link host/sim.c
+ * instead of host/timer.c).
+ *
+ * Time only moves when the program calls sim_run_until. Interrupts are
+ * delivered like on the hardware: an edge sets the pin's pending flag (several
+ * edges before the handler runs count once), the handler runs `latency` after
+ * the flag was set, reads the pins as they are at that moment, and keeps the
+ * (single) CPU busy for `isr` ticks, so edges in the meantime wait.
+ *
+ * The real time spent in the handlers is measured, to compare the cost of
+ * different versions of a driver.
+ */
+
+#include "gpio.h"
+#include <stdbool.h>
+
+typedef struct {
+    unsigned long gpio_calls;   // GPIO interrupt handler calls
+    unsigned long timer_calls;  // hstimer interrupt handler calls
+    unsigned long gpio_ns;      // real time spent in GPIO handlers
+    unsigned long gpio_max_ns;  // slowest GPIO handler call
+    unsigned long edges;        // pin changes
+    unsigned long coalesced;    // edges which found the pending flag set
+} sim_stats_t;
+
+/*
+ * `sim_init` starts the simulation at time 0, with no pins or handlers. Call it
+ * once, before initializing any driver.
+ *
+ * @param latency_ticks     from edge to handler
+ * @param isr_ticks         simulated duration of every handler
+ */
+void sim_init(unsigned long latency_ticks, unsigned long isr_ticks);
+
+/*
+ * `sim_drive` sets the level of an input pin at the current time, raising its
+ * interrupt if configured for that edge.
+ */
+void sim_drive(gpio_id_t pin, int level);
+
+/*
+ * `sim_run_until` moves the clock to `ticks`, running every interrupt handler
+ * which is due on the way.
+ */
+void sim_run_until(unsigned long ticks);
+
+/*
+ * `sim_now` returns the current simulated time, in ticks.
+ */
+unsigned long sim_now(void);
+
+/*
+ * `sim_stats` returns the handler statistics since the last sim_clear_stats.
+ */
+const sim_stats_t *sim_stats(void);
+
+/*
+ * `sim_clear_stats` sets all statistics back to 0.
+ */
+void sim_clear_stats(void);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef HOST_STRINGS_H
+#define HOST_STRINGS_H
+
+/*
+ * Host replacement for the strings module of libmango: the C library already
+ * provides everything it declares.
+ */
+
+#include <string.h>
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * Host implementation of the timer module (see host/timer.h).
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "timer.h"
+#include <time.h>
+
+unsigned long timer_get_ticks(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000000UL + ts.tv_nsec) * TICKS_PER_USEC / 1000;
+}
+
+void timer_delay_us(int usec) {
+    unsigned long start = timer_get_ticks();
+    while (timer_get_ticks() - start < (unsigned long)usec * TICKS_PER_USEC) ;
+}
+
+void timer_delay_ms(int msec) {
+    timer_delay_us(1000 * msec);
+}
+
+void timer_delay(int secs) {
+    timer_delay_us(1000 * 1000 * secs);
+}
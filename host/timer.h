@@ -0,0 +1,17 @@
+#ifndef HOST_TIMER_H
+#define HOST_TIMER_H
+
+/*
+ * Host replacement for the timer module of libmango, so that hardware
+ * independent modules can be compiled and run on a Linux host. Ticks run at
+ * the same rate as on the Mango Pi.
+ */
+
+#define TICKS_PER_USEC 24
+
+unsigned long timer_get_ticks(void);
+void timer_delay_us(int usec);
+void timer_delay_ms(int msec);
+void timer_delay(int secs);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+/*
+ * Short critical sections that are safe to use both from the main program and
+ * from interrupt handlers.
+ *
+ * Unlike interrupts_global_disable/interrupts_global_enable, which
+ * unconditionally turn interrupts back on, irq_restore puts back whatever
+ * state irq_save found. That matters when the code runs inside a handler (for
+ * example, a JNXU handler which sends a message), where turning interrupts on
+ * would allow handlers to nest.
+ *
+ * Typical usage:
+ *
+ *     unsigned long flags = irq_save();
+ *     ... touch state shared with a handler ...
+ *     irq_restore(flags);
+ *
+ * On a host build there are no interrupts, so both do nothing.
+ */
+
+#define IRQ_MSTATUS_MIE (1 << 3)
+
+static inline unsigned long irq_save(void) {
+#if defined(__riscv)
+    unsigned long mstatus;
+    __asm__ volatile ("csrrci %0, mstatus, %1" : "=r"(mstatus) : "i"(IRQ_MSTATUS_MIE) : "memory");
+    return mstatus & IRQ_MSTATUS_MIE;
+#else
+    return 0;
+#endif
+}
+
+static inline void irq_restore(unsigned long flags) {
+#if defined(__riscv)
+    __asm__ volatile ("csrs mstatus, %0" : : "r"(flags & IRQ_MSTATUS_MIE) : "memory");
+#else
+    (void)flags;
+#endif
+}
+
+#endif
@@ -1,15 +1,14 @@
 /*
  * Module implementing the JNXU protocol, a simple protocol for sending messages
  * over UART. The protocol is designed to be used in a non-blocking manner,
- * alongside bt_ext, but can be easily modified to use a similar module for
- * a different communication medium.
+ * alongside bt_ext, but runs on any transport in transport.h.
  *
  * Author: Javier Garcia Nieto <jgnieto@stanford.edu>
  */
 #include "assert.h"
 #include "strings.h"
 #include "jnxu.h"
-#include "bt_ext.h"
+#include "transport.h"
 #include "timer.h"
 
 // Javier Garcia Nieto and Ellen Xu
@@ -17,11 +16,13 @@
 
 #define NUM_CMDS        256
 
-#define RECONNECT_DELAY_USEC (5 * 1000 * 1000) // 5 seconds
-#define RECONNECT_CHECKS 10
-#define RECONNECT_RETRIES 1 // after much testing, we found retries are typically a bad idea.
+#define ECHO_TIMEOUT_USEC   (500 * 1000) // 500 ms
 
-extern void bt_ext_force_set_connected(void);
+// bytes are staged in chunks of this size before being handed to the transport
+#define SEND_CHUNK      64
+
+// bytes read from the transport at once
+#define READ_CHUNK      256
 
 enum message_state {
     WAITING_FOR_START = 0,
@@ -42,8 +43,12 @@ static struct {
     uint8_t message[JNXU_MAX_MESSAGE_LEN];
     int message_len;
 
-    bt_ext_role_t role;
-    char mac[13];
+    const transport_t *transport;
+
+    // kept up to date by the transport (see link_changed), if it reports
+    // link changes; otherwise the transport is asked before every send
+    bool link_events;
+    volatile bool link_up;
 
     volatile unsigned long last_ping;
     volatile unsigned long last_echo;
@@ -57,44 +62,66 @@ void jnxu_register_handler(uint8_t cmd, jnxu_handler_t fn, void *aux_data) {
 
 /*
  * This function ensures that the device is connected to the other end of the
- * Bluetooth link. It will attempt to reconnect if the device is not connected.
+ * link. It will attempt to reconnect if the device is not connected.
  *
  * @return  `true` if the device is connected, `false` otherwise.
  */
 static bool ensure_connected(void) {
-    if (bt_ext_connected())
-            return true;
+    const transport_t *t = module.transport;
+    if (module.link_events ? module.link_up : t->connected())
+        return true;
 
     // sometimes the card is already connected, so it's best to try a ping first
     jnxu_ping();
     unsigned long previous_echo = module.last_echo;
-    unsigned long timeout_time = timer_get_ticks() + (500 * 1000 * TICKS_PER_USEC);
+    unsigned long timeout_time = timer_get_ticks() + (ECHO_TIMEOUT_USEC * TICKS_PER_USEC);
 
     while (timer_get_ticks() < timeout_time) {
+        jnxu_poll();
         if (previous_echo != module.last_echo) {
-            bt_ext_force_set_connected();
+            if (t->confirm_connected != NULL)
+                t->confirm_connected();
+            module.link_up = true;
             return true;
         }
     }
 
-    for (int i = 0; i < RECONNECT_RETRIES; i++) {
-        if (bt_ext_connected()) {
-            return true;
-        }
-
-        bt_ext_connect(module.role, module.mac);
+    // the transport does not report a change if the link was already up (i.e.
+    // it came up before the callback was registered), so note it here too
+    if (t->connect != NULL && t->connect()) {
+        module.link_up = true;
+        return true;
+    }
+    return false;
+}
 
-        // give time to connect, but leave if we are connected earlier
-        for (int i = 0; i < RECONNECT_CHECKS; i++) {
-            if (bt_ext_connected()) {
-                return true;
-            }
+/*
+ * Bytes of an outgoing packet are staged here and handed to the transport in
+ * spans rather than one at a time. Lives on the stack of the sender, since
+ * handlers (which run in interrupt context) may send too.
+ */
+typedef struct {
+    uint8_t buf[SEND_CHUNK];
+    size_t len;
+    bool failed;    // the transport dropped part of the packet
+} frame_t;
 
-            timer_delay_us(RECONNECT_DELAY_USEC / RECONNECT_CHECKS);
-        }
+/*
+ * Hands the staged bytes to the transport. Once the transport drops some, the
+ * packet is truncated, so the frame is marked as failed.
+ */
+static void frame_flush(frame_t *frame) {
+    if (frame->len > 0) {
+        if (module.transport->send(frame->buf, frame->len) < frame->len)
+            frame->failed = true;
+        frame->len = 0;
     }
+}
 
-    return false;
+static void frame_put(frame_t *frame, uint8_t byte) {
+    if (frame->len == sizeof(frame->buf))
+        frame_flush(frame);
+    frame->buf[frame->len++] = byte;
 }
 
 bool jnxu_send(uint8_t cmd, const uint8_t *message, int len) {
@@ -104,12 +131,14 @@ bool jnxu_send(uint8_t cmd, const uint8_t *message, int len) {
         return false;
     }
 
+    frame_t frame = { .len = 0, .failed = false };
+
     // start of message
-    bt_ext_send_raw_byte(JNXU_PREFIX);
-    bt_ext_send_raw_byte(JNXU_START);
+    frame_put(&frame, JNXU_PREFIX);
+    frame_put(&frame, JNXU_START);
 
     // send the command id
-    bt_ext_send_raw_byte(cmd);
+    frame_put(&frame, cmd);
 
     // send each byte of the message, escaping as necessary
     for (int i = 0; i < len; i++) {
@@ -117,47 +146,46 @@ bool jnxu_send(uint8_t cmd, const uint8_t *message, int len) {
             case JNXU_PREFIX:
                 // when sending a prefix, we need to escape it with another
                 // prefix (i.e. send && instead of &)
-                bt_ext_send_raw_byte(JNXU_PREFIX);
+                frame_put(&frame, JNXU_PREFIX);
                 break;
             case 'T':
                 // avoid sending "AT", which would be interpreted as a command
                 // by the HC-05 module, so send "A&_T" instead
                 if (i > 0 && message[i - 1] == 'A') {
-                    bt_ext_send_raw_byte(JNXU_PREFIX);
-                    bt_ext_send_raw_byte(JNXU_STUFFING);
+                    frame_put(&frame, JNXU_PREFIX);
+                    frame_put(&frame, JNXU_STUFFING);
                 }
                 break;
             case 'K':
                 // avoid sending "OK", which would be interpreted as a response
                 // by the HC-05 module, so send "O&_K" instead
                 if (i > 0 && message[i - 1] == 'O') {
-                    bt_ext_send_raw_byte(JNXU_PREFIX);
-                    bt_ext_send_raw_byte(JNXU_STUFFING);
+                    frame_put(&frame, JNXU_PREFIX);
+                    frame_put(&frame, JNXU_STUFFING);
                 }
                 break;
         }
         // after escaping, send the byte
-        bt_ext_send_raw_byte(message[i]);
+        frame_put(&frame, message[i]);
     }
 
     // end of message
-    bt_ext_send_raw_byte(JNXU_PREFIX);
-    bt_ext_send_raw_byte(JNXU_END);
+    frame_put(&frame, JNXU_PREFIX);
+    frame_put(&frame, JNXU_END);
+    frame_flush(&frame);
 
-    return true;
+    return !frame.failed;
 }
 
 bool jnxu_ping(void) {
     module.last_ping = timer_get_ticks();
 
-    bt_ext_send_raw_byte(JNXU_PREFIX);
-    bt_ext_send_raw_byte(JNXU_PING);
-
-    return true;
+    static const uint8_t PING[] = { JNXU_PREFIX, JNXU_PING };
+    return module.transport->send(PING, sizeof(PING)) == sizeof(PING);
 }
 
 /*
- * This function processes a byte received from the Bluetooth module. It
+ * This function processes a byte received from the transport. It
  * processes the byte according to the current state of the protocol.
  *
  * @param byte  byte to process.
@@ -192,8 +220,10 @@ static void process_byte(uint8_t byte) {
                 break;
             case JNXU_PING:
                 // respond to ping with echo
-                bt_ext_send_raw_byte(JNXU_PREFIX);
-                bt_ext_send_raw_byte(JNXU_ECHO);
+                {
+                    static const uint8_t ECHO[] = { JNXU_PREFIX, JNXU_ECHO };
+                    module.transport->send(ECHO, sizeof(ECHO));
+                }
                 break;
             case JNXU_ECHO:
                 // update last echo time
@@ -227,37 +257,48 @@ normal_process:
 }
 
 /*
- * This function processes the incoming data from the Bluetooth module. It
- * clears the queue byte by byte, calling `process_byte` for each byte.
+ * This function processes the incoming data from the transport. It clears the
+ * queue byte by byte, calling `process_byte` for each byte.
  */
 static void process_uart(void) {
-    // use twice the theoretical maximum length to avoid buffer overflows
-    uint8_t buf[2 * BT_EXT_MAX_BYTES_NO_TRIGGER];
-    while (bt_ext_has_data()) {
-        int len = bt_ext_read(buf, sizeof(buf));
-        for (int i = 0; i < len; i++) {
+    uint8_t buf[READ_CHUNK];
+    while (module.transport->has_data()) {
+        size_t len = module.transport->read(buf, sizeof(buf));
+        for (size_t i = 0; i < len; i++) {
             process_byte(buf[i]);
         }
     }
 }
 
-void jnxu_init(bt_ext_role_t role, const char *mac) {
-    // copy the role and mac address
-    module.role = role;
-    memcpy(module.mac, mac, sizeof(module.mac));
+void jnxu_poll(void) {
+    if (module.transport->poll != NULL)
+        module.transport->poll();
+}
 
-    // initialize the connection
-    bt_ext_init();
-    ensure_connected();
+/*
+ * Link callback, called by the transport (usually from an interrupt) when the
+ * link comes up or goes down.
+ */
+static void link_changed(bool connected) {
+    module.link_up = connected;
+}
 
-    // register trigers for all relevant characters
-    bt_ext_register_trigger(JNXU_PREFIX, process_uart);
-    bt_ext_register_trigger(JNXU_START, process_uart);
-    bt_ext_register_trigger(JNXU_END, process_uart);
-    bt_ext_register_trigger(JNXU_PING, process_uart);
-    bt_ext_register_trigger(JNXU_ECHO, process_uart);
+void jnxu_init(const transport_t *transport) {
+    module.transport = transport;
 
-    // fallback trigger
-    bt_ext_register_fallback_trigger(process_uart);
-}
+    if (transport->register_link_callback != NULL) {
+        module.link_up = transport->connected();
+        module.link_events = true;
+        transport->register_link_callback(link_changed);
+    }
 
+    // initialize the connection (before registering the triggers, which would
+    // otherwise swallow the responses to AT commands)
+    ensure_connected();
+
+    // register trigers for all relevant characters (plus the fallback)
+    static const uint8_t TRIGGERS[] = {
+        JNXU_PREFIX, JNXU_START, JNXU_END, JNXU_PING, JNXU_ECHO,
+    };
+    transport->register_rx_callback(process_uart, TRIGGERS, sizeof(TRIGGERS));
+}
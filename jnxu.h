@@ -4,7 +4,7 @@
 /*
  * Module implementing the JNXU protocol, a simple protocol for sending messages
  * over UART. The protocol is designed to be used in a non-blocking manner,
- * alongside bt_ext.
+ * on top of any of the transports in transport.h (typically bt_ext).
  *
  * Author: Javier Garcia Nieto <jgnieto@stanford.edu>
  */
@@ -44,15 +44,18 @@
  * we simply send "&&_" instead, which escapes the first ampersand.
  *
  * Example usage:
- *  - call jnxu_init() with the connection information once.
+ *  - call jnxu_init() with the transport once (i.e.
+ *      `jnxu_init(transport_bt_init(role, mac))`).
  *  - call jnxu_register_handler() as many times as necessary to register all
  *      commands.
  *  - call jnxu_send() whenever a message must be send.
  *  - one side should regularly call jnxu_ping() as a sanity check that the
  *      connection is alive.
+ *  - if the transport is not interrupt-driven (anything but bt_ext), call
+ *      jnxu_poll() regularly to process incoming data.
  */
 
-#include "bt_ext.h"
+#include "transport.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -116,12 +119,16 @@ bool jnxu_send(uint8_t cmd, const uint8_t *message, int len);
 bool jnxu_ping(void);
 
 /*
- * `jnxu_init` initializes the JNXU module.
+ * `jnxu_poll` processes any data waiting in the transport. Only necessary for
+ * transports which are not interrupt-driven, does nothing otherwise.
+ */
+void jnxu_poll(void);
+
+/*
+ * `jnxu_init` initializes the JNXU module and connects over the transport.
  *
- * @param role  role of the device in the JNXU protocol
- * @param mac   MAC address of the other device (if role is PRIMARY, otherwise
- *                  this parameter is ignored and can be NULL)
+ * @param transport transport to run the protocol on (see transport.h)
  */
-void jnxu_init(bt_ext_role_t role, const char *mac);
+void jnxu_init(const transport_t *transport);
 
 #endif
@@ -0,0 +1,345 @@
+/*
+ * Entering a move with the cursor (see move_entry.h).
+ */
+#include "move_entry.h"
+#include "chess_commands.h"
+
+#define CLAMP(x, min, max) ((x) > (max) ? (max) : ((x) < (min) ? (min) : (x)))
+
+static const char PROMOTION_PIECE_NAMES[] = { 'r', 'n', 'b', 'q' };
+static const movegen_piece_t PROMOTION_PIECES[] = {
+    MOVEGEN_ROOK, MOVEGEN_KNIGHT, MOVEGEN_BISHOP, MOVEGEN_QUEEN,
+};
+
+// index of the queen in PROMOTION_PIECE_NAMES
+#define PROMOTION_QUEEN 3
+
+/*
+ * Converts between a square of the position (see movegen.h) and one from the
+ * wearer's side (y * 8 + x), both ways.
+ */
+static int flip_side(int side, int square) {
+    return (side == WHITE) ? square : 63 - square;
+}
+
+static int flip(const move_entry_t *entry, int square) {
+    return flip_side(entry->side, square);
+}
+
+static int cursor_square(const move_entry_t *entry) {
+    return entry->cursor_y * 8 + entry->cursor_x;
+}
+
+static void place_cursor(move_entry_t *entry, int square) {
+    entry->cursor_x = square % 8;
+    entry->cursor_y = square / 8;
+}
+
+/*
+ * Squares (bits of y * 8 + x) where the cursor may stop: those of the pieces
+ * that can move, or those the piece chosen can move to. If the piece chosen
+ * cannot move (the position changed), the choice is undone.
+ */
+static uint64_t legal_squares(move_entry_t *entry) {
+    movegen_move_t moves[MOVEGEN_MAX_MOVES];
+    size_t count = movegen_generate(entry->position, moves);
+    int from = flip(entry, entry->move[1] * 8 + entry->move[0]);
+
+    uint64_t from_squares = 0, to_squares = 0;
+    for (size_t i = 0; i < count; i++) {
+        from_squares |= 1ULL << flip(entry, moves[i].from);
+        if (moves[i].from == from)
+            to_squares |= 1ULL << flip(entry, moves[i].to);
+    }
+
+    if (move_entry_piece_chosen(entry)) {
+        if (to_squares)
+            return to_squares;
+        entry->state = MOVE_ENTRY_X0;
+    }
+    return from_squares;
+}
+
+/*
+ * Checks whether the move selected (from and to squares) is a promotion.
+ */
+static bool is_promotion(const move_entry_t *entry) {
+    movegen_move_t moves[MOVEGEN_MAX_MOVES];
+    size_t count = movegen_generate(entry->position, moves);
+    int from = flip(entry, entry->move[1] * 8 + entry->move[0]);
+    int to = flip(entry, entry->move[3] * 8 + entry->move[2]);
+
+    for (size_t i = 0; i < count; i++) {
+        if (moves[i].from == from && moves[i].to == to && moves[i].promotion != MOVEGEN_EMPTY)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Position of a square in the order the cursor walks: along the ranks, or
+ * along the files.
+ */
+static int walk_order(int square, bool by_file) {
+    return by_file ? (square % 8) * 8 + square / 8 : square;
+}
+
+/*
+ * The next square of `squares` after `from` in the walk, in `direction`
+ * (1 or -1), or `from` if there is none.
+ */
+static int step_square(uint64_t squares, int from, int direction, bool by_file) {
+    int best = from, best_distance = 0;
+
+    for (int square = 0; square < 64; square++) {
+        if (!(squares >> square & 1))
+            continue;
+
+        int distance = (walk_order(square, by_file) - walk_order(from, by_file)) * direction;
+        if (distance > 0 && (best_distance == 0 || distance < best_distance)) {
+            best = square;
+            best_distance = distance;
+        }
+    }
+    return best;
+}
+
+/*
+ * The square of `squares` closest to `to`, -1 if there are none.
+ */
+static int nearest_square(uint64_t squares, int to) {
+    int best = -1, best_distance = 0;
+
+    for (int square = 0; square < 64; square++) {
+        if (!(squares >> square & 1))
+            continue;
+
+        int dx = square % 8 - to % 8, dy = square / 8 - to / 8;
+        int distance = (dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy);
+        if (best < 0 || distance < best_distance) {
+            best = square;
+            best_distance = distance;
+        }
+    }
+    return best;
+}
+
+/*
+ * Selects the square under the cursor, following the position: the piece, or
+ * its destination. A piece with a single destination goes there right away.
+ *
+ * @return          `true` if the move is complete
+ */
+static bool select_square(move_entry_t *entry) {
+    uint64_t squares = legal_squares(entry);
+    int cursor = cursor_square(entry);
+    if (squares == 0)
+        return false; // no legal moves
+
+    if (!(squares >> cursor & 1)) {
+        // the position changed under the cursor
+        place_cursor(entry, nearest_square(squares, cursor));
+        return false;
+    }
+
+    if (!move_entry_piece_chosen(entry)) {
+        entry->move[0] = entry->cursor_x;
+        entry->move[1] = entry->cursor_y;
+        entry->state = MOVE_ENTRY_X1;
+
+        squares = legal_squares(entry);
+        place_cursor(entry, nearest_square(squares, cursor));
+        if (squares & (squares - 1))
+            return false; // more than one destination
+    }
+
+    entry->move[2] = entry->cursor_x;
+    entry->move[3] = entry->cursor_y;
+    entry->state = MOVE_ENTRY_PROMOTION;
+    entry->cursor_promotion = is_promotion(entry) ? PROMOTION_QUEEN : -1;
+    return entry->cursor_promotion < 0;
+}
+
+/*
+ * Enters the candidate under the cursor, or switches to entering the move
+ * square by square.
+ *
+ * @return          `true` if the move is complete
+ */
+static bool select_candidate(move_entry_t *entry) {
+    if (entry->cursor_candidate >= entry->ncandidates) {
+        entry->state = MOVE_ENTRY_X0;
+        return false;
+    }
+
+    const int *candidate = entry->candidates[entry->cursor_candidate];
+    for (int i = 0; i < 4; i++)
+        entry->move[i] = candidate[i];
+    entry->cursor_promotion = candidate[4];
+    entry->state = MOVE_ENTRY_PROMOTION;
+    return true;
+}
+
+void move_entry_reset(move_entry_t *entry) {
+    entry->cursor_x = 0;
+    entry->cursor_y = 7;
+    entry->cursor_promotion = -1;
+    entry->cursor_candidate = 0;
+    entry->state = entry->ncandidates > 0 ? MOVE_ENTRY_CANDIDATE : MOVE_ENTRY_X0;
+
+    if (entry->position != NULL) {
+        int square = nearest_square(legal_squares(entry), cursor_square(entry));
+        if (square >= 0)
+            place_cursor(entry, square);
+    }
+}
+
+void move_entry_follow(move_entry_t *entry, const movegen_position_t *position, int side) {
+    entry->position = position;
+    entry->side = side;
+}
+
+void move_entry_candidates(move_entry_t *entry, const movegen_move_t *moves, int count,
+        int side) {
+    if (moves == NULL || count > MOVE_ENTRY_MAX_CANDIDATES)
+        count = moves ? MOVE_ENTRY_MAX_CANDIDATES : 0;
+
+    for (int i = 0; i < count; i++) {
+        int from = flip_side(side, moves[i].from), to = flip_side(side, moves[i].to);
+        int *candidate = entry->candidates[i];
+        candidate[0] = from % 8;
+        candidate[1] = from / 8;
+        candidate[2] = to % 8;
+        candidate[3] = to / 8;
+
+        candidate[4] = -1;
+        for (int piece = 0; piece < 4; piece++) {
+            if (moves[i].promotion == PROMOTION_PIECES[piece])
+                candidate[4] = piece;
+        }
+    }
+    entry->ncandidates = count;
+}
+
+void move_entry_cursor(move_entry_t *entry, int motion, bool other_axis) {
+    if (entry->state == MOVE_ENTRY_CANDIDATE) {
+        // one past the last candidate is entering another move
+        entry->cursor_candidate = CLAMP(entry->cursor_candidate + motion, 0, entry->ncandidates);
+        return;
+    }
+
+    if (entry->position != NULL) {
+        if (entry->state == MOVE_ENTRY_PROMOTION) {
+            // a promotion needs a piece
+            entry->cursor_promotion = CLAMP(entry->cursor_promotion + motion, 0, 3);
+            return;
+        }
+
+        uint64_t squares = legal_squares(entry);
+        int square = cursor_square(entry);
+        for (int i = 0; i < (motion < 0 ? -motion : motion); i++)
+            square = step_square(squares, square, motion < 0 ? -1 : 1, other_axis);
+        place_cursor(entry, square);
+        return;
+    }
+
+    switch (entry->state) {
+        case MOVE_ENTRY_X0:
+        case MOVE_ENTRY_X1:
+            if (other_axis)
+                entry->cursor_y += motion;
+            else
+                entry->cursor_x += motion;
+            break;
+        case MOVE_ENTRY_Y0:
+        case MOVE_ENTRY_Y1:
+            if (other_axis)
+                entry->cursor_x += motion;
+            else
+                entry->cursor_y += motion;
+            break;
+        case MOVE_ENTRY_PROMOTION:
+            entry->cursor_promotion += motion;
+            break;
+        case MOVE_ENTRY_CANDIDATE:
+            break; // see above
+    }
+
+    entry->cursor_x = CLAMP(entry->cursor_x, 0, 7);
+    entry->cursor_y = CLAMP(entry->cursor_y, 0, 7);
+    entry->cursor_promotion = CLAMP(entry->cursor_promotion, -1, 3);
+}
+
+bool move_entry_press(move_entry_t *entry) {
+    if (entry->state == MOVE_ENTRY_CANDIDATE)
+        return select_candidate(entry);
+    if (entry->position != NULL && entry->state != MOVE_ENTRY_PROMOTION)
+        return select_square(entry);
+
+    switch (entry->state) {
+        case MOVE_ENTRY_X0:
+        case MOVE_ENTRY_X1:
+            entry->move[entry->state] = entry->cursor_x;
+            break;
+
+        case MOVE_ENTRY_Y1:
+            entry->cursor_promotion = -1;
+            // fall through
+        case MOVE_ENTRY_Y0:
+            entry->move[entry->state] = entry->cursor_y;
+            break;
+
+        case MOVE_ENTRY_PROMOTION:
+        case MOVE_ENTRY_CANDIDATE:
+            return true;
+    }
+
+    entry->state++;
+    return false;
+}
+
+bool move_entry_confirm(move_entry_t *entry) {
+    if (entry->state == MOVE_ENTRY_CANDIDATE)
+        return select_candidate(entry);
+    if (entry->position != NULL && entry->state != MOVE_ENTRY_PROMOTION)
+        return select_square(entry);
+
+    switch (entry->state) {
+        case MOVE_ENTRY_X0:
+        case MOVE_ENTRY_Y0:
+            entry->move[0] = entry->cursor_x;
+            entry->move[1] = entry->cursor_y;
+            entry->state = MOVE_ENTRY_X1;
+            return false;
+
+        case MOVE_ENTRY_X1:
+        case MOVE_ENTRY_Y1:
+            entry->move[2] = entry->cursor_x;
+            entry->move[3] = entry->cursor_y;
+            entry->cursor_promotion = -1;
+            entry->state = MOVE_ENTRY_PROMOTION;
+            return true;
+
+        case MOVE_ENTRY_PROMOTION:
+        default:
+            return true;
+    }
+}
+
+bool move_entry_piece_chosen(const move_entry_t *entry) {
+    return entry->state == MOVE_ENTRY_X1 || entry->state == MOVE_ENTRY_Y1;
+}
+
+void move_entry_uci(const move_entry_t *entry, int side, char uci[6]) {
+    for (int i = 0; i < 4; i++) {
+        int c = (side == WHITE) ? entry->move[i] : 7 - entry->move[i];
+        uci[i] = (i % 2 ? '1' : 'a') + c;
+    }
+
+    if (entry->cursor_promotion >= 0) {
+        uci[4] = PROMOTION_PIECE_NAMES[entry->cursor_promotion];
+        uci[5] = '\0';
+    } else {
+        uci[4] = '\0';
+    }
+}
@@ -0,0 +1,137 @@
+#ifndef MOVE_ENTRY_H
+#define MOVE_ENTRY_H
+
+/*
+ * Entering a move with the cursor, one step at a time: the from square's file
+ * and rank, the to square's file and rank, and the promotion piece.
+ *
+ * It runs on the hand, which only sends the brain the finished move (and,
+ * every now and then, where the cursor is, for the screen), so entering a move
+ * does not wait for the radio. The brain runs it too, for hands which still
+ * send every turn and press.
+ *
+ * Coordinates are from the wearer's side of the board (file 0 on their left,
+ * rank 0 closest to them).
+ *
+ * Given the position (see move_entry_follow), only legal moves can be entered:
+ * the cursor skips to the squares of the pieces that can move, and then to the
+ * squares that piece can move to, and a press selects the whole square. A
+ * piece with a single destination moves there on the first press, and only
+ * promotions ask for a piece.
+ *
+ * Given the opponent's likely moves (see move_entry_candidates), those are
+ * offered first: the cursor steps through them, and a press enters the one
+ * under it. One step past the last one, a press switches to entering the move
+ * square by square.
+ */
+
+#include "movegen.h"
+#include <stdbool.h>
+
+// likely moves offered at most
+#define MOVE_ENTRY_MAX_CANDIDATES 8
+
+typedef enum {
+    MOVE_ENTRY_X0 = 0,
+    MOVE_ENTRY_Y0,
+    MOVE_ENTRY_X1,
+    MOVE_ENTRY_Y1,
+    MOVE_ENTRY_PROMOTION,
+    MOVE_ENTRY_CANDIDATE,
+} move_entry_state_t;
+
+typedef struct {
+    int cursor_x;
+    int cursor_y;
+    int cursor_promotion;       // -1 for none, else rook, knight, bishop, queen
+    move_entry_state_t state;   // what the next press selects
+    int move[4];                // x0, y0, x1, y1, as selected so far
+
+    const movegen_position_t *position; // NULL to walk every square
+    int side;                   // the wearer's, WHITE or BLACK
+
+    int candidates[MOVE_ENTRY_MAX_CANDIDATES][5];   // move, then promotion
+    int ncandidates;
+    int cursor_candidate;       // ncandidates for entering another move
+} move_entry_t;
+
+/*
+ * `move_entry_reset` starts over, on the first candidate if there are any (see
+ * move_entry_candidates), else with the cursor on the wearer's top left (or
+ * the piece that can move nearest to it).
+ *
+ * @param entry     the move being entered
+ */
+void move_entry_reset(move_entry_t *entry);
+
+/*
+ * `move_entry_follow` makes the cursor stop only where a legal move of a
+ * position can go (see above). The position is read, not copied, every time
+ * the cursor moves, so it must not change meanwhile. The setting is kept
+ * across resets.
+ *
+ * @param entry     the move being entered
+ * @param position  the position, NULL to walk every square again
+ * @param side      WHITE or BLACK (see chess_commands.h), the wearer's side
+ */
+void move_entry_follow(move_entry_t *entry, const movegen_position_t *position, int side);
+
+/*
+ * `move_entry_candidates` sets the likely moves to offer first, from the next
+ * reset on. They are copied.
+ *
+ * @param entry     the move being entered
+ * @param moves     the moves, the most likely first, NULL if none
+ * @param count     how many (at most MOVE_ENTRY_MAX_CANDIDATES are kept)
+ * @param side      WHITE or BLACK (see chess_commands.h), the wearer's side
+ */
+void move_entry_candidates(move_entry_t *entry, const movegen_move_t *moves, int count,
+        int side);
+
+/*
+ * `move_entry_cursor` moves the cursor along the axis being selected, or along
+ * the other one if `other_axis` (the promotion menu and the candidates only
+ * have one).
+ *
+ * @param entry     the move being entered
+ * @param motion    signed number of squares (or promotion pieces)
+ * @param other_axis    whether to move along the other axis
+ */
+void move_entry_cursor(move_entry_t *entry, int motion, bool other_axis);
+
+/*
+ * `move_entry_press` selects the coordinate (or promotion piece) under the
+ * cursor, or the whole square when following a position.
+ *
+ * @param entry     the move being entered
+ * @return          `true` if the move is complete (see move_entry_uci)
+ */
+bool move_entry_press(move_entry_t *entry);
+
+/*
+ * `move_entry_confirm` selects both coordinates of the square under the cursor
+ * at once. At the destination square, the move is complete, without promotion.
+ *
+ * @param entry     the move being entered
+ * @return          `true` if the move is complete (see move_entry_uci)
+ */
+bool move_entry_confirm(move_entry_t *entry);
+
+/*
+ * `move_entry_piece_chosen` checks whether the from square has been selected.
+ *
+ * @param entry     the move being entered
+ * @return          `true` while selecting the destination square
+ */
+bool move_entry_piece_chosen(const move_entry_t *entry);
+
+/*
+ * `move_entry_uci` writes a complete move in UCI notation, null-terminated.
+ *
+ * @param entry     the move entered
+ * @param side      WHITE or BLACK (see chess_commands.h), the wearer's side
+ * @param uci       where to write it ("e2e4", "e7e8q")
+ */
+void move_entry_uci(const move_entry_t *entry, int side, char uci[6]);
+
+#endif
@@ -0,0 +1,333 @@
+/*
+ * Legal move generator (see movegen.h).
+ *
+ * The board is a plain array of 64 squares: moves are generated piece by piece,
+ * and a move is legal if the king of the side making it is not attacked once
+ * it is played on a copy of the position. Slow next to a real engine, but a
+ * position takes well under a millisecond and nothing is allocated.
+ */
+#include "movegen.h"
+#include "chess_commands.h"
+
+#define FILE_OF(sq) ((sq) & 7)
+#define RANK_OF(sq) ((sq) >> 3)
+#define SQUARE(file, rank) ((rank) * 8 + (file))
+
+// (file, rank) steps
+static const int8_t KNIGHT_STEPS[8][2] = {
+    { 1, 2 }, { 2, 1 }, { 2, -1 }, { 1, -2 }, { -1, -2 }, { -2, -1 }, { -2, 1 }, { -1, 2 },
+};
+
+// the rook's directions, then the bishop's (a king or queen uses all of them)
+static const int8_t DIRECTIONS[8][2] = {
+    { 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 }, { 1, 1 }, { -1, 1 }, { -1, -1 }, { 1, -1 },
+};
+
+static const int8_t BACK_RANK[8] = {
+    MOVEGEN_ROOK, MOVEGEN_KNIGHT, MOVEGEN_BISHOP, MOVEGEN_QUEEN,
+    MOVEGEN_KING, MOVEGEN_BISHOP, MOVEGEN_KNIGHT, MOVEGEN_ROOK,
+};
+
+static const char PROMOTION_NAMES[] = "  nbrq";
+
+typedef struct {
+    const movegen_position_t *pos;
+    movegen_move_t *moves;
+    size_t n;
+} list_t;
+
+/*
+ * The square one step away, or -1 if it is off the board.
+ */
+static int step(int sq, const int8_t direction[2]) {
+    int file = FILE_OF(sq) + direction[0];
+    int rank = RANK_OF(sq) + direction[1];
+
+    if (file < 0 || file > 7 || rank < 0 || rank > 7)
+        return -1;
+    return SQUARE(file, rank);
+}
+
+/*
+ * Whether a square is attacked by any piece of side `by`.
+ */
+static bool attacked(const movegen_position_t *pos, int sq, int by) {
+    // a pawn attacks diagonally forward, so look diagonally backward from it
+    for (int df = -1; df <= 1; df += 2) {
+        const int8_t back[2] = { df, -by };
+        int from = step(sq, back);
+        if (from >= 0 && pos->board[from] == by * MOVEGEN_PAWN)
+            return true;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        int from = step(sq, KNIGHT_STEPS[i]);
+        if (from >= 0 && pos->board[from] == by * MOVEGEN_KNIGHT)
+            return true;
+
+        from = step(sq, DIRECTIONS[i]);
+        if (from >= 0 && pos->board[from] == by * MOVEGEN_KING)
+            return true;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        int slider = (i < 4) ? MOVEGEN_ROOK : MOVEGEN_BISHOP;
+        for (int from = step(sq, DIRECTIONS[i]); from >= 0; from = step(from, DIRECTIONS[i])) {
+            int8_t piece = pos->board[from];
+            if (piece == by * slider || piece == by * MOVEGEN_QUEEN)
+                return true;
+            if (piece != MOVEGEN_EMPTY)
+                break;
+        }
+    }
+
+    return false;
+}
+
+static bool in_check(const movegen_position_t *pos, int side) {
+    for (int sq = 0; sq < 64; sq++) {
+        if (pos->board[sq] == side * MOVEGEN_KING)
+            return attacked(pos, sq, -side);
+    }
+    return false;
+}
+
+/*
+ * Castling rights lost when a piece moves from or to a square.
+ */
+static uint8_t castling_lost(int sq) {
+    switch (sq) {
+        case SQUARE(0, 0): return MOVEGEN_WHITE_QUEENSIDE;
+        case SQUARE(7, 0): return MOVEGEN_WHITE_KINGSIDE;
+        case SQUARE(4, 0): return MOVEGEN_WHITE_KINGSIDE | MOVEGEN_WHITE_QUEENSIDE;
+        case SQUARE(0, 7): return MOVEGEN_BLACK_QUEENSIDE;
+        case SQUARE(7, 7): return MOVEGEN_BLACK_KINGSIDE;
+        case SQUARE(4, 7): return MOVEGEN_BLACK_KINGSIDE | MOVEGEN_BLACK_QUEENSIDE;
+        default:           return 0;
+    }
+}
+
+/*
+ * Adds a move if it does not leave the king of the side making it in check.
+ */
+static void add(list_t *list, int from, int to, int promotion) {
+    movegen_move_t move = { from, to, promotion };
+    movegen_position_t after = *list->pos;
+
+    movegen_apply(&after, &move);
+    if (!in_check(&after, list->pos->side))
+        list->moves[list->n++] = move;
+}
+
+static void add_pawn(list_t *list, int from, int to) {
+    int last_rank = (list->pos->side == WHITE) ? 7 : 0;
+
+    if (RANK_OF(to) != last_rank) {
+        add(list, from, to, MOVEGEN_EMPTY);
+        return;
+    }
+
+    for (int piece = MOVEGEN_KNIGHT; piece <= MOVEGEN_QUEEN; piece++)
+        add(list, from, to, piece);
+}
+
+static void pawn_moves(list_t *list, int from) {
+    const movegen_position_t *pos = list->pos;
+    int side = pos->side;
+    int start_rank = (side == WHITE) ? 1 : 6;
+
+    int to = from + 8 * side;
+    if (pos->board[to] == MOVEGEN_EMPTY) {
+        add_pawn(list, from, to);
+        if (RANK_OF(from) == start_rank && pos->board[to + 8 * side] == MOVEGEN_EMPTY)
+            add(list, from, to + 8 * side, MOVEGEN_EMPTY);
+    }
+
+    for (int df = -1; df <= 1; df += 2) {
+        const int8_t diagonal[2] = { df, side };
+        to = step(from, diagonal);
+        if (to >= 0 && (pos->board[to] * side < 0 || to == pos->en_passant))
+            add_pawn(list, from, to);
+    }
+}
+
+/*
+ * Moves of a piece going one step (`slide` false) or any number of steps in
+ * the given directions.
+ */
+static void piece_moves(list_t *list, int from, const int8_t (*directions)[2], int n, bool slide) {
+    const movegen_position_t *pos = list->pos;
+
+    for (int i = 0; i < n; i++) {
+        for (int to = step(from, directions[i]); to >= 0; to = step(to, directions[i])) {
+            int8_t piece = pos->board[to];
+            if (piece * pos->side > 0)
+                break; // own piece
+
+            add(list, from, to, MOVEGEN_EMPTY);
+            if (piece != MOVEGEN_EMPTY || !slide)
+                break;
+        }
+    }
+}
+
+static void castling_moves(list_t *list, int from) {
+    const movegen_position_t *pos = list->pos;
+    int side = pos->side;
+    uint8_t kingside = (side == WHITE) ? MOVEGEN_WHITE_KINGSIDE : MOVEGEN_BLACK_KINGSIDE;
+    uint8_t queenside = (side == WHITE) ? MOVEGEN_WHITE_QUEENSIDE : MOVEGEN_BLACK_QUEENSIDE;
+
+    if (!(pos->castling & (kingside | queenside)) || attacked(pos, from, -side))
+        return;
+
+    // the king may not pass through an attacked square (landing on one is
+    // checked by add, like any other move)
+    if ((pos->castling & kingside)
+            && pos->board[from + 1] == MOVEGEN_EMPTY && pos->board[from + 2] == MOVEGEN_EMPTY
+            && !attacked(pos, from + 1, -side))
+        add(list, from, from + 2, MOVEGEN_EMPTY);
+
+    if ((pos->castling & queenside)
+            && pos->board[from - 1] == MOVEGEN_EMPTY && pos->board[from - 2] == MOVEGEN_EMPTY
+            && pos->board[from - 3] == MOVEGEN_EMPTY
+            && !attacked(pos, from - 1, -side))
+        add(list, from, from - 2, MOVEGEN_EMPTY);
+}
+
+static unsigned order(const movegen_move_t *move) {
+    return ((unsigned)move->from << 9) | ((unsigned)move->to << 3) | move->promotion;
+}
+
+void movegen_init(movegen_position_t *pos) {
+    for (int sq = 0; sq < 64; sq++)
+        pos->board[sq] = MOVEGEN_EMPTY;
+
+    for (int file = 0; file < 8; file++) {
+        pos->board[SQUARE(file, 0)] = BACK_RANK[file];
+        pos->board[SQUARE(file, 1)] = MOVEGEN_PAWN;
+        pos->board[SQUARE(file, 6)] = -MOVEGEN_PAWN;
+        pos->board[SQUARE(file, 7)] = -BACK_RANK[file];
+    }
+
+    pos->side = WHITE;
+    pos->castling = MOVEGEN_WHITE_KINGSIDE | MOVEGEN_WHITE_QUEENSIDE
+                  | MOVEGEN_BLACK_KINGSIDE | MOVEGEN_BLACK_QUEENSIDE;
+    pos->en_passant = -1;
+}
+
+size_t movegen_generate(const movegen_position_t *pos, movegen_move_t *moves) {
+    list_t list = { pos, moves, 0 };
+
+    for (int from = 0; from < 64; from++) {
+        int8_t piece = pos->board[from] * pos->side;
+        if (piece <= 0)
+            continue; // empty or not ours
+
+        switch (piece) {
+            case MOVEGEN_PAWN:
+                pawn_moves(&list, from);
+                break;
+            case MOVEGEN_KNIGHT:
+                piece_moves(&list, from, KNIGHT_STEPS, 8, false);
+                break;
+            case MOVEGEN_BISHOP:
+                piece_moves(&list, from, DIRECTIONS + 4, 4, true);
+                break;
+            case MOVEGEN_ROOK:
+                piece_moves(&list, from, DIRECTIONS, 4, true);
+                break;
+            case MOVEGEN_QUEEN:
+                piece_moves(&list, from, DIRECTIONS, 8, true);
+                break;
+            case MOVEGEN_KING:
+                piece_moves(&list, from, DIRECTIONS, 8, false);
+                castling_moves(&list, from);
+                break;
+        }
+    }
+
+    // already grouped by from square, so the insertion sort only reorders the
+    // few moves of each piece
+    for (size_t i = 1; i < list.n; i++) {
+        movegen_move_t move = moves[i];
+        size_t j = i;
+        for (; j > 0 && order(&moves[j - 1]) > order(&move); j--)
+            moves[j] = moves[j - 1];
+        moves[j] = move;
+    }
+
+    return list.n;
+}
+
+void movegen_apply(movegen_position_t *pos, const movegen_move_t *move) {
+    int8_t piece = pos->board[move->from];
+    int side = pos->side;
+    int from = move->from, to = move->to;
+
+    if (piece == side * MOVEGEN_PAWN && to == pos->en_passant)
+        pos->board[to - 8 * side] = MOVEGEN_EMPTY; // the pawn captured en passant
+
+    if (piece == side * MOVEGEN_KING && to - from == 2) {
+        pos->board[from + 1] = pos->board[from + 3];
+        pos->board[from + 3] = MOVEGEN_EMPTY;
+    } else if (piece == side * MOVEGEN_KING && from - to == 2) {
+        pos->board[from - 1] = pos->board[from - 4];
+        pos->board[from - 4] = MOVEGEN_EMPTY;
+    }
+
+    pos->board[to] = move->promotion ? side * move->promotion : piece;
+    pos->board[from] = MOVEGEN_EMPTY;
+
+    if (piece == side * MOVEGEN_PAWN && (to - from == 16 || from - to == 16))
+        pos->en_passant = (from + to) / 2;
+    else
+        pos->en_passant = -1;
+
+    pos->castling &= ~(castling_lost(from) | castling_lost(to));
+    pos->side = -side;
+}
+
+int movegen_find(const movegen_position_t *pos, const char *uci, movegen_move_t *move,
+        size_t *count) {
+    for (int i = 0; i < 4; i++) {
+        char min = i % 2 ? '1' : 'a';
+        if (uci[i] < min || uci[i] > min + 7)
+            return -1;
+    }
+
+    int from = SQUARE(uci[0] - 'a', uci[1] - '1');
+    int to = SQUARE(uci[2] - 'a', uci[3] - '1');
+
+    int promotion = MOVEGEN_QUEEN;
+    for (int piece = MOVEGEN_KNIGHT; piece <= MOVEGEN_QUEEN; piece++) {
+        if (uci[4] == PROMOTION_NAMES[piece])
+            promotion = piece;
+    }
+
+    movegen_move_t moves[MOVEGEN_MAX_MOVES];
+    size_t n = movegen_generate(pos, moves);
+    if (count != NULL)
+        *count = n;
+
+    for (size_t i = 0; i < n; i++) {
+        if (moves[i].from != from || moves[i].to != to)
+            continue;
+        if (moves[i].promotion != MOVEGEN_EMPTY && moves[i].promotion != promotion)
+            continue;
+
+        if (move != NULL)
+            *move = moves[i];
+        return i;
+    }
+
+    return -1;
+}
+
+void movegen_format(const movegen_move_t *move, char uci[6]) {
+    uci[0] = 'a' + FILE_OF(move->from);
+    uci[1] = '1' + RANK_OF(move->from);
+    uci[2] = 'a' + FILE_OF(move->to);
+    uci[3] = '1' + RANK_OF(move->to);
+    uci[4] = move->promotion ? PROMOTION_NAMES[move->promotion] : '\0';
+    uci[5] = '\0';
+}
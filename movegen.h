@@ -0,0 +1,102 @@
+#ifndef MOVEGEN_H
+#define MOVEGEN_H
+
+/*
+ * Legal move generator, small enough for both devices to keep track of the
+ * game, so that a move can be sent (and buzzed) as its index among the legal
+ * moves of the position instead of as its squares.
+ *
+ * Squares are numbered from a1 = 0 to h8 = 63 (rank * 8 + file), from white's
+ * side whoever is playing. Pieces are positive for white and negative for
+ * black.
+ *
+ * The moves of a position are always generated in the same, canonical order:
+ * by from square, then by to square, then by promotion piece (knight, bishop,
+ * rook, queen). Both devices generating the same list is what makes an index
+ * mean the same move on both.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// no position has more legal moves than this (the record is 218)
+#define MOVEGEN_MAX_MOVES 256
+
+typedef enum {
+    MOVEGEN_EMPTY = 0,
+    MOVEGEN_PAWN,
+    MOVEGEN_KNIGHT,
+    MOVEGEN_BISHOP,
+    MOVEGEN_ROOK,
+    MOVEGEN_QUEEN,
+    MOVEGEN_KING,
+} movegen_piece_t;
+
+// castling rights
+#define MOVEGEN_WHITE_KINGSIDE  (1 << 0)
+#define MOVEGEN_WHITE_QUEENSIDE (1 << 1)
+#define MOVEGEN_BLACK_KINGSIDE  (1 << 2)
+#define MOVEGEN_BLACK_QUEENSIDE (1 << 3)
+
+typedef struct {
+    int8_t board[64];
+    int8_t side;        // to move, WHITE or BLACK (see chess_commands.h)
+    uint8_t castling;   // MOVEGEN_*SIDE bits still allowed
+    int8_t en_passant;  // square a pawn can capture en passant on, or -1
+} movegen_position_t;
+
+typedef struct {
+    uint8_t from;
+    uint8_t to;
+    uint8_t promotion;  // movegen_piece_t, MOVEGEN_EMPTY if none
+} movegen_move_t;
+
+/*
+ * `movegen_init` sets up the starting position, white to move.
+ *
+ * @param pos       the position
+ */
+void movegen_init(movegen_position_t *pos);
+
+/*
+ * `movegen_generate` lists the legal moves of a position, in canonical order.
+ *
+ * @param pos       the position
+ * @param moves     where to store them, room for MOVEGEN_MAX_MOVES
+ * @return          how many there are (0 for checkmate and stalemate)
+ */
+size_t movegen_generate(const movegen_position_t *pos, movegen_move_t *moves);
+
+/*
+ * `movegen_apply` plays a legal move (one returned by movegen_generate) on a
+ * position.
+ *
+ * @param pos       the position
+ * @param move      the move
+ */
+void movegen_apply(movegen_position_t *pos, const movegen_move_t *move);
+
+/*
+ * `movegen_find` looks up a move in UCI notation ("e2e4", "e7e8q") among the
+ * legal moves of a position. A promotion without a piece is to a queen.
+ *
+ * @param pos       the position
+ * @param uci       the move
+ * @param move      where to store it (may be NULL)
+ * @param count     where to store the number of legal moves (may be NULL)
+ * @return          its index in canonical order, -1 if it is not legal
+ */
+int movegen_find(const movegen_position_t *pos, const char *uci, movegen_move_t *move,
+        size_t *count);
+
+/*
+ * `movegen_format` writes a move in UCI notation, null-terminated (at most 6
+ * bytes, with the promotion).
+ *
+ * @param move      the move
+ * @param uci       where to write it
+ */
+void movegen_format(const movegen_move_t *move, char uci[6]);
+
+#endif
@@ -10,48 +10,267 @@
 #include "gpio_interrupt.h"
 #include "interrupts.h"
 #include "malloc.h"
-#include "ringbuffer_ptr.h"
+#include "ringq.h"
 #include "timer.h"
 #include <stdint.h>
 
+/*
+ * Queues an event (by value). Called from the interrupt handlers, so it must
+ * not allocate. If the queue is full, the event is dropped (the queue counts
+ * it in its overflow statistics).
+ */
+static void push_event(re_device_t *dev, re_event_t event) {
+    re_queue_enqueue(&dev->queue, event);
+}
+
+/*
+ * Quadrature state transitions, indexed by (previous state << 2) | state,
+ * where a state is (clock << 1) | data. Valid transitions (a single channel
+ * changed) count +1 clockwise or -1 counterclockwise. No change, or both
+ * channels changing at once (an edge was missed), counts 0.
+ *
+ * Turning clockwise, data leads: 11 -> 10 -> 00 -> 01 -> 11.
+ */
+static const int8_t QUADRATURE_TABLE[16] = {
+     0, +1, -1,  0,
+    -1,  0,  0, +1,
+    +1,  0,  0, -1,
+     0, -1, +1,  0,
+};
+
+/*
+ * Steps per detent depending on the time since the previous detent (in the
+ * same direction). Slow turns move one step per detent, fast spins more.
+ */
+static const struct {
+    unsigned long max_usec;
+    int steps;
+} ACCELERATION[] = {
+    { 12 * 1000, 4 },
+    { 25 * 1000, 2 },
+};
+
+/*
+ * Returns the number of steps a detent in the given direction is worth, based
+ * on how fast the knob is turning.
+ */
+static int accelerate(re_device_t *dev, int direction, unsigned long now) {
+    unsigned long dt = now - dev->last_detent;
+    bool same_direction = direction == dev->last_direction;
+
+    dev->last_detent = now;
+    dev->last_direction = direction;
+
+    if (same_direction) {
+        for (int i = 0; i < sizeof(ACCELERATION) / sizeof(*ACCELERATION); i++) {
+            if (dt < ACCELERATION[i].max_usec * TICKS_PER_USEC)
+                return direction * ACCELERATION[i].steps;
+        }
+    }
+
+    return direction;
+}
+
+/*
+ * Alarm function, runs RE_GESTURE_TIMEOUT_USEC after the last detent of a
+ * burst and emits its net rotation.
+ */
+static void flush_gesture(void *aux_data) {
+    re_device_t *dev = (re_device_t*)aux_data;
+
+    re_event_t event = {
+        .type = dev->gesture_held ? RE_EVENT_PRESS_TURN : RE_EVENT_GESTURE,
+        .ticks = timer_get_ticks(),
+        .steps = dev->gesture_steps,
+    };
+    dev->gesture_steps = 0;
+
+    push_event(dev, event);
+}
+
+/*
+ * Records a detent in the current burst and (re)starts the timeout which ends
+ * the burst.
+ */
+static void extend_gesture(re_device_t *dev, int steps) {
+    if (!alarm_pending(&dev->gesture_alarm))
+        dev->gesture_held = dev->sw_down;
+
+    // turning with the button held is its own gesture, the press is used up
+    if (dev->sw_down)
+        dev->press_used = true;
+
+    dev->gesture_steps += steps;
+    alarm_set(&dev->gesture_alarm, RE_GESTURE_TIMEOUT_USEC, flush_gesture, dev);
+}
+
+/*
+ * Decodes the current state of both channels. Called on every edge of either
+ * channel. Contact bounce shows up as a step forwards immediately followed by
+ * a step backwards, which cancel out, so no debouncing is needed. Steps are
+ * accumulated and a single event is emitted per detent, when the encoder
+ * settles in its resting state.
+ */
+static void decode(re_device_t *dev) {
+    int state = (gpio_read(dev->clock) << 1) | gpio_read(dev->data);
+
+    dev->steps += QUADRATURE_TABLE[(dev->state << 2) | state];
+    dev->state = state;
+
+    if (state != RE_REST_STATE)
+        return;
+
+    // Back at rest: a detent happened if we got (at least) half way there, which
+    // tolerates a missed edge. Otherwise it was just noise or a partial turn.
+    int steps = dev->steps;
+    dev->steps = 0;
+
+    unsigned long now = timer_get_ticks();
+
+    if (steps >= RE_STEPS_PER_DETENT / 2) {
+        re_event_t event = {
+            .type = RE_EVENT_CLOCKWISE,
+            .ticks = now,
+            .steps = accelerate(dev, 1, now),
+        };
+        dev->angle--;
+        push_event(dev, event);
+        extend_gesture(dev, event.steps);
+    } else if (steps <= -RE_STEPS_PER_DETENT / 2) {
+        re_event_t event = {
+            .type = RE_EVENT_COUNTERCLOCKWISE,
+            .ticks = now,
+            .steps = accelerate(dev, -1, now),
+        };
+        dev->angle++;
+        push_event(dev, event);
+        extend_gesture(dev, event.steps);
+    }
+}
+
 void handle_clock(uintptr_t pc, void *data) {
     re_device_t *dev = (re_device_t*)data;
     gpio_interrupt_clear(dev->clock);
+    decode(dev);
+}
 
-    // read pin states
-    int clk_state = gpio_read(dev->clock);
-    int data_state = gpio_read(dev->data);
+void handle_data(uintptr_t pc, void *data) {
+    re_device_t *dev = (re_device_t*)data;
+    gpio_interrupt_clear(dev->data);
+    decode(dev);
+}
 
-    // create event struct
-    unsigned long now = timer_get_ticks();
-    re_event_t *event = malloc(sizeof(re_event_t));
-    event->ticks = now;
-    
-    if (clk_state == data_state) {
-        // data leads, clockwise
-        event->type = RE_EVENT_CLOCKWISE;
-        dev->angle--;
+/*
+ * Pushes a button gesture (no steps).
+ */
+static void push_press(re_device_t *dev, re_event_type_t type) {
+    re_event_t event = {
+        .type = type,
+        .ticks = timer_get_ticks(),
+    };
+
+    push_event(dev, event);
+}
+
+/*
+ * Alarm function, runs RE_LONG_PRESS_USEC after the button went down.
+ */
+static void long_press(void *aux_data) {
+    re_device_t *dev = (re_device_t*)aux_data;
+
+    if (dev->sw_down && !dev->press_used) {
+        dev->press_used = true;
+        push_press(dev, RE_EVENT_LONG_PRESS);
+    }
+}
+
+/*
+ * Alarm function, runs RE_DOUBLE_PRESS_USEC after a short press was released
+ * without the button being pressed again.
+ */
+static void single_press(void *aux_data) {
+    re_device_t *dev = (re_device_t*)aux_data;
+
+    dev->click_pending = false;
+    push_press(dev, RE_EVENT_PUSH);
+}
+
+/*
+ * Ends the current rotation burst now, so that turns before and after the
+ * button changed state are reported as different gestures.
+ */
+static void split_gesture(re_device_t *dev) {
+    if (alarm_pending(&dev->gesture_alarm)) {
+        alarm_cancel(&dev->gesture_alarm);
+        flush_gesture(dev);
+    }
+}
+
+static void button_settled(void *aux_data);
+
+/*
+ * Acts on a debounced change of the button, which settles for
+ * RE_SW_DEBOUNCE_USEC from now on.
+ */
+static void button_changed(re_device_t *dev, bool down, unsigned long now) {
+    dev->last_edge = now;
+    dev->sw_down = down;
+    alarm_set(&dev->debounce_alarm, RE_SW_DEBOUNCE_USEC, button_settled, dev);
+    split_gesture(dev);
+
+    if (down) {
+        if (dev->click_pending) {
+            // second press soon after a short one
+            alarm_cancel(&dev->press_alarm);
+            dev->click_pending = false;
+            dev->press_used = true;
+            push_press(dev, RE_EVENT_DOUBLE_PRESS);
+        } else {
+            dev->press_used = false;
+            alarm_set(&dev->press_alarm, RE_LONG_PRESS_USEC, long_press, dev);
+        }
     } else {
-        // clock leads, counterclockwise
-        event->type = RE_EVENT_COUNTERCLOCKWISE;
-        dev->angle++;
+        alarm_cancel(&dev->press_alarm);
+
+        if (!dev->press_used) {
+            // short press, unless a second one follows
+            dev->click_pending = true;
+            alarm_set(&dev->press_alarm, RE_DOUBLE_PRESS_USEC, single_press, dev);
+        }
     }
+}
 
-    rb_ptr_enqueue(dev->rb, (uintptr_t)event);
+/*
+ * Alarm function, runs RE_SW_DEBOUNCE_USEC after a change of the button. Edges
+ * inside that window are ignored, so a press and release which both fall in it
+ * leave sw_down wrong. The pin is read again here and, if it no longer matches,
+ * the missed change is applied now.
+ */
+static void button_settled(void *aux_data) {
+    re_device_t *dev = (re_device_t*)aux_data;
+
+    bool down = gpio_read(dev->sw) == 0;
+    if (down != dev->sw_down)
+        button_changed(dev, down, timer_get_ticks());
 }
 
 void handle_button(uintptr_t pc, void *data) {
     re_device_t* dev = (re_device_t*)data;
     gpio_interrupt_clear(dev->sw);
 
-    // create event struct
     unsigned long now = timer_get_ticks();
-    re_event_t *event = malloc(sizeof(re_event_t));
+    bool down = gpio_read(dev->sw) == 0;
 
-    event->ticks = now;
-    event->type = RE_EVENT_PUSH;
+    // The switch bounces for a few milliseconds after every change, each bounce
+    // being another edge. Only the first edge counts, and only if the button
+    // actually changed state. Whatever happens during the window is picked up
+    // by button_settled when it ends.
+    if (down == dev->sw_down)
+        return;
+    if (now - dev->last_edge < RE_SW_DEBOUNCE_USEC * TICKS_PER_USEC)
+        return;
 
-    rb_ptr_enqueue(dev->rb, (uintptr_t)event);
+    button_changed(dev, down, now);
 }
 
 re_device_t *re_new(gpio_id_t clock_gpio, gpio_id_t data_gpio, gpio_id_t sw_gpio) {
@@ -70,40 +289,58 @@ re_device_t *re_new(gpio_id_t clock_gpio, gpio_id_t data_gpio, gpio_id_t sw_gpio
     gpio_set_input(dev->sw);
     gpio_set_pullup(dev->sw);
 
-    // allocate ringbuffer for rotary encoder events (stored as pointers).
-    dev->rb = rb_ptr_new();
+    // start decoding from wherever the encoder is resting now
+    dev->state = (gpio_read(dev->clock) << 1) | gpio_read(dev->data);
+    dev->steps = 0;
+    dev->angle = 0;
+    dev->last_detent = 0;
+    dev->last_direction = 0;
+    dev->gesture_alarm.pending = false;
+    dev->gesture_steps = 0;
+    dev->gesture_held = false;
+    dev->last_edge = timer_get_ticks() - RE_SW_DEBOUNCE_USEC * TICKS_PER_USEC;
+    dev->debounce_alarm.pending = false;
+    dev->sw_down = gpio_read(dev->sw) == 0;
+    dev->press_used = true; // if it starts held, that press does not count
+    dev->click_pending = false;
+    dev->press_alarm.pending = false;
+
+    // ringbuffer for rotary encoder events (stored by value).
+    re_queue_init(&dev->queue);
+    re_queue_register(&dev->queue, "re.events");
 
     // set up interrupts
     // use the data pointer of the interrupt to store the deviece
     gpio_interrupt_init();
+    alarm_init();
 
-    gpio_interrupt_config(dev->clock, GPIO_INTERRUPT_NEGATIVE_EDGE, true);
+    // both edges of both channels, without the hardware debouncer (which
+    // would eat edges when spinning fast, the table takes care of bounce)
+    gpio_interrupt_config(dev->clock, GPIO_INTERRUPT_DOUBLE_EDGE, false);
     gpio_interrupt_register_handler(dev->clock, handle_clock, dev);
     gpio_interrupt_enable(dev->clock);
 
-    gpio_interrupt_config(dev->sw, GPIO_INTERRUPT_NEGATIVE_EDGE, true);
+    gpio_interrupt_config(dev->data, GPIO_INTERRUPT_DOUBLE_EDGE, false);
+    gpio_interrupt_register_handler(dev->data, handle_data, dev);
+    gpio_interrupt_enable(dev->data);
+
+    // both edges of the button, since gestures depend on press and release
+    gpio_interrupt_config(dev->sw, GPIO_INTERRUPT_DOUBLE_EDGE, true);
     gpio_interrupt_register_handler(dev->sw, handle_button, dev);
     gpio_interrupt_enable(dev->sw);
 
     return dev;
 }
 
-re_event_t *re_read(re_device_t* dev) {
-    uintptr_t result;
-    if (rb_ptr_dequeue(dev->rb, &result)) {
-        // success
-        return (re_event_t *)result;
-    } else {
-        // failure
-        return NULL;
-    }
+bool re_read(re_device_t* dev, re_event_t *event) {
+    return re_queue_dequeue(&dev->queue, event);
 }
 
-re_event_t *re_read_blocking(re_device_t* dev) {
-    uintptr_t result;
-
-    while (!rb_ptr_dequeue(dev->rb, &result)) {} // spin
+bool re_has_event(re_device_t* dev) {
+    return !re_queue_empty(&dev->queue);
+}
 
-    return (re_event_t *)result;
+void re_read_blocking(re_device_t* dev, re_event_t *event) {
+    while (!re_queue_dequeue(&dev->queue, event)) {} // spin
 }
 
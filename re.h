@@ -5,38 +5,107 @@
  * Module to drive rotary encoder. Uses three GPIO pins (clock, data and the
  * push button).
  *
+ * Both edges of both channels are decoded (4x) with a state transition table,
+ * which rejects contact bounce, and one event is emitted per detent. The push
+ * button is debounced in time.
+ *
+ * Rotation events carry a step count which grows with the rotation speed, so
+ * that spinning the knob fast moves further than turning it detent by detent.
+ * When the knob has been still for RE_GESTURE_TIMEOUT_USEC after turning, an
+ * alarm (see alarm.h) emits a RE_EVENT_GESTURE with the net steps of the whole
+ * burst, right at the timeout, no matter how busy the main loop is.
+ *
+ * Button activity is classified into gestures from the press and release
+ * timestamps:
+ *  - short press (RE_EVENT_PUSH): released quickly, and not pressed again
+ *    within RE_DOUBLE_PRESS_USEC (so it is reported after that window)
+ *  - double press: pressed again within RE_DOUBLE_PRESS_USEC of a short press
+ *  - long press: held for RE_LONG_PRESS_USEC (reported while still held)
+ *  - press and turn: turning while the button is held reports the burst as
+ *    RE_EVENT_PRESS_TURN instead of RE_EVENT_GESTURE, and no press at all
+ *
  * Author: Ellen Xu <ellenjxu@stanford.edu>
  * Author: Javier Garcia Nieto <jgnieto@stanford.edu>
  */
 
+#include "alarm.h"
 #include "gpio.h"
-#include "ringbuffer_ptr.h"
+#include "ringq.h"
 
-typedef struct re_device {
-    gpio_id_t clock;
-    gpio_id_t data;
-    gpio_id_t sw;
-    rb_ptr_t *rb;
-    int angle;
-} re_device_t;
+// Events are stored by value, so the interrupt handlers never allocate. If the
+// queue is full, new events are dropped (and counted in queue.stats). Both the
+// clock and the button handlers write to it, hence multi-producer.
+#define RE_QUEUE_LENGTH 256
+
+// quadrature steps between two detents, and the state (clock << 1 | data) the
+// encoder rests in at a detent (both pins pulled up)
+#define RE_STEPS_PER_DETENT 4
+#define RE_REST_STATE       0b11
+
+// a burst of rotation is over after this long without detents
+#define RE_GESTURE_TIMEOUT_USEC (60 * 1000)
+
+// button edges closer than this to the previous one are considered bounce
+#define RE_SW_DEBOUNCE_USEC (30 * 1000)
+
+// button gestures
+#define RE_LONG_PRESS_USEC   (600 * 1000)
+#define RE_DOUBLE_PRESS_USEC (250 * 1000)
 
 typedef enum {
     RE_EVENT_NONE = 0,
     RE_EVENT_CLOCKWISE,
     RE_EVENT_COUNTERCLOCKWISE,
-    RE_EVENT_PUSH,
+    RE_EVENT_PUSH,          // short press
+    RE_EVENT_GESTURE,       // end of a rotation burst, `steps` is the net total
+    RE_EVENT_LONG_PRESS,
+    RE_EVENT_DOUBLE_PRESS,
+    RE_EVENT_PRESS_TURN,    // like RE_EVENT_GESTURE, turned with the button held
 } re_event_type_t;
 
 typedef struct {
     re_event_type_t type;
     unsigned long ticks;
+    int steps;  // rotation and gestures with turns only: signed steps after
+                // acceleration (see re.c), positive clockwise
 } re_event_t;
 
+RINGQ_MPSC_DECLARE(re_queue, re_event_t, RE_QUEUE_LENGTH)
+
+typedef struct re_device {
+    gpio_id_t clock;
+    gpio_id_t data;
+    gpio_id_t sw;
+    re_queue_t queue;
+    int angle;
+
+    // quadrature decoder
+    int state;  // last (clock << 1) | data
+    int steps;  // quarter steps since the last detent
+
+    unsigned long last_edge;  // ticks, for debouncing the button
+    alarm_t debounce_alarm;   // samples the button again once it settled
+    unsigned long last_detent; // ticks, for acceleration
+    int last_direction;        // +1 clockwise, -1 counterclockwise
+
+    // current rotation burst, flushed by gesture_alarm
+    alarm_t gesture_alarm;
+    int gesture_steps;
+    bool gesture_held;  // the burst started with the button held
+
+    // button gestures
+    bool sw_down;
+    bool press_used;    // the current press already produced its gesture
+    bool click_pending; // a short press waits to see if a second one follows
+    alarm_t press_alarm;    // long press while down, double press window after
+} re_device_t;
+
 /*
  * `re_new` creates a new rotary encoder device with the given GPIO pins.
  *
- * NOTE: Remember to call interrupts_init and interrupts_global_enable!
- * 
+ * NOTE: Remember to call interrupts_init and interrupts_global_enable! The
+ * alarm module is initialized here if it was not already.
+ *
  * @param clock_gpio    the GPIO pin for the clock (i.e. GPIO_PB0)
  * @param data_gpio     the GPIO pin for the data (i.e. GPIO_PD22)
  * @param sw_gpio       the GPIO pin for the switch (i.e. GPIO_PD21)
@@ -47,13 +116,22 @@ re_device_t *re_new(gpio_id_t clock_gpio, gpio_id_t data_gpio, gpio_id_t sw_gpio
 /*
  * `re_read` reads the next event from the rotary encoder
  *
- * Read the next event from the rotary encoder. If there is no event, it will
- * return NULL.
+ * Read the next event from the rotary encoder, if there is one.
+ *
+ * @param dev   pointer to a rotary encoder device (obtained from re_new())
+ * @param event where to store the event
+ * @return      `true` if an event was stored in `event`, `false` if there was
+ *                  no event
+ */
+bool re_read(re_device_t* dev, re_event_t *event);
+
+/*
+ * `re_has_event` checks whether there is an event to read, without reading it.
  *
  * @param dev   pointer to a rotary encoder device (obtained from re_new())
- * @return      pointer to an event struct (to be freed by caller), or NULL
+ * @return      `true` if re_read would return an event
  */
-re_event_t *re_read(re_device_t* dev);
+bool re_has_event(re_device_t* dev);
 
 /*
  * `re_read_blocking` read the next event from the rotary encoder, blocking
@@ -62,8 +140,8 @@ re_event_t *re_read(re_device_t* dev);
  * block until there is one.
 
  * @param dev   pointer to a rotary encoder device (obtained from re_new())
- * @return      pointer to an event struct (to be freed by caller)
+ * @param event where to store the event
  */
-re_event_t *re_read_blocking(re_device_t* dev);
+void re_read_blocking(re_device_t* dev, re_event_t *event);
 
 #endif
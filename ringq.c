@@ -0,0 +1,41 @@
+/*
+ * Registry of ring buffers (see ringq.h), to print the state of every queue
+ * in the program with one call.
+ */
+#include "ringq.h"
+#include "printf.h"
+
+static ringq_stats_t *registered;
+
+void ringq_register(ringq_stats_t *stats, const char *name) {
+    stats->name = name;
+
+    // do not add it twice (i.e. if a queue is registered again after init)
+    for (ringq_stats_t *s = registered; s != NULL; s = s->next) {
+        if (s == stats) return;
+    }
+
+    stats->next = registered;
+    registered = stats;
+}
+
+void ringq_dump(void) {
+    printf("%16s %6s %6s %6s %10s %10s %10s\n",
+            "queue", "cap", "used", "high", "enqueued", "dequeued", "overflows");
+
+    for (ringq_stats_t *s = registered; s != NULL; s = s->next) {
+        // snapshot, since the counters may change while printing
+        unsigned long enqueued = s->enqueued;
+        unsigned long dequeued = s->dequeued;
+        unsigned long overflows = s->overflows;
+
+        printf("%16s %6d %6d %6d %10ld %10ld %10ld\n",
+                s->name,
+                (int)s->capacity,
+                (int)(enqueued - dequeued),
+                (int)s->high_water,
+                enqueued,
+                dequeued,
+                overflows);
+    }
+}
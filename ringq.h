@@ -0,0 +1,347 @@
+#ifndef RINGQ_H
+#define RINGQ_H
+
+/*
+ * Typed, header-only ring buffers (replaces ringbuffer_ptr and the uses of the
+ * libmango integer ringbuffer).
+ *
+ * RINGQ_DECLARE(name, type, capacity) declares a type `name_t` holding up to
+ * `capacity` elements of `type` inline (no heap), along with static inline
+ * functions to operate on it:
+ *
+ *     name_init(rb)                       empties the queue
+ *     name_count(rb), name_empty(rb), name_full(rb)
+ *     name_enqueue(rb, elem)              false if full
+ *     name_dequeue(rb, &elem)             false if empty
+ *     name_peek(rb, &elem)                like dequeue, without removing
+ *     name_enqueue_bulk(rb, elems, n)     returns number enqueued (<= n)
+ *     name_dequeue_bulk(rb, elems, n)     returns number dequeued (<= n)
+ *     name_claim(rb)                      pointer to the next free slot, to be
+ *                                         filled in place (NULL if full)
+ *     name_publish(rb)                    enqueues the claimed slot
+ *
+ * For example:
+ *
+ *     RINGQ_DECLARE(byte_queue, uint8_t, 256)
+ *     static byte_queue_t rx;
+ *     byte_queue_enqueue(&rx, 'a');
+ *
+ * Capacity must be a power of two: head and tail are free-running counters and
+ * the slot is found by masking, which avoids both the `%` and the wasted slot
+ * of the original ringbuffer.
+ *
+ * Like the original, the queue allows lock-free concurrent access by one
+ * reader (dequeue/peek) and one writer (enqueue), typically an interrupt
+ * handler writing and the main program reading. The writer only ever stores
+ * tail and the reader only ever stores head. Fences order the accesses to the
+ * slots with respect to those stores: the writer fills the slot before
+ * publishing the new tail, and the reader is done with the slot before
+ * publishing the new head (so the writer cannot overwrite it too early).
+ *
+ * INSTRUMENTATION:
+ * Every queue keeps a ringq_stats_t with its high-water mark, the number of
+ * elements enqueued and dequeued and the number of elements that did not fit
+ * (overflows). Registering a queue with name_register(rb, "label") adds it to
+ * a global list, and ringq_dump() prints the state of every registered queue
+ * over the console UART (see ringq.c). Use it to size the queues from data.
+ *
+ * MULTIPLE PRODUCERS:
+ * RINGQ_MPSC_DECLARE(name, type, capacity) declares the same kind of queue
+ * (init, empty, enqueue, peek, dequeue; no bulk operations), but any number of
+ * writers may enqueue concurrently, for example several interrupt handlers
+ * feeding one stream, even if they nest. There must still be one reader.
+ *
+ * Writers reserve a position by advancing tail with a compare-and-swap, fill
+ * the slot, and then publish it by updating the slot's sequence number, so a
+ * writer interrupted halfway never blocks other writers. The reader only takes
+ * a slot once it has been published. (On the Mango Pi, which has a single
+ * core and no atomic instructions in rv64im, the compare-and-swap is made
+ * atomic by masking interrupts for its two instructions.)
+ */
+
+#include "irq.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__riscv)
+// all earlier reads/writes complete before any later write
+#define ringq_release() __asm__ volatile ("fence rw, w" : : : "memory")
+// all earlier reads complete before any later read/write
+#define ringq_acquire() __asm__ volatile ("fence r, rw" : : : "memory")
+#else
+#define ringq_release() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define ringq_acquire() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+typedef struct ringq_stats {
+    const char *name;
+    unsigned int capacity;
+    volatile unsigned int high_water;   // most elements ever held at once
+    volatile unsigned long enqueued;
+    volatile unsigned long dequeued;
+    volatile unsigned long overflows;   // elements dropped because it was full
+    struct ringq_stats *next;           // next registered queue
+} ringq_stats_t;
+
+/*
+ * `ringq_register` adds the statistics of a queue to the list printed by
+ * ringq_dump. Usually called through name_register(rb, label).
+ *
+ * @param stats     statistics of the queue
+ * @param name      label to print (not copied, must stay valid)
+ */
+void ringq_register(ringq_stats_t *stats, const char *name);
+
+/*
+ * `ringq_dump` prints capacity, occupancy, high-water mark, enqueued and
+ * dequeued totals and overflows of every registered queue with printf.
+ */
+void ringq_dump(void);
+
+static inline void ringq_stats_init(ringq_stats_t *stats, unsigned int capacity) {
+    stats->capacity = capacity;
+    stats->high_water = 0;
+    stats->enqueued = stats->dequeued = stats->overflows = 0;
+}
+
+static inline void ringq_stats_level(ringq_stats_t *stats, unsigned int count) {
+    if (count > stats->high_water)
+        stats->high_water = count;
+}
+
+/*
+ * Adds to a counter which several writers may update concurrently.
+ */
+static inline void ringq_add(volatile unsigned long *counter, unsigned long n) {
+#if defined(__riscv) && !defined(__riscv_atomic)
+    unsigned long flags = irq_save();
+    *counter += n;
+    irq_restore(flags);
+#else
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+#endif
+}
+
+/*
+ * If *p equals *expected, stores desired in *p and returns true. Otherwise,
+ * stores the current value of *p in *expected and returns false.
+ */
+static inline bool ringq_cas(volatile unsigned int *p, unsigned int *expected, unsigned int desired) {
+#if defined(__riscv) && !defined(__riscv_atomic)
+    unsigned long flags = irq_save();
+    unsigned int current = *p;
+    bool ok = current == *expected;
+    if (ok)
+        *p = desired;
+    else
+        *expected = current;
+    irq_restore(flags);
+    return ok;
+#else
+    return __atomic_compare_exchange_n(p, expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+#define RINGQ_DECLARE(name, type, capacity)                                     \
+                                                                                \
+_Static_assert((capacity) > 0 && ((capacity) & ((capacity) - 1)) == 0,         \
+        #name ": capacity must be a power of two");                             \
+                                                                                \
+typedef struct {                                                                \
+    type entries[capacity];                                                     \
+    volatile unsigned int head, tail;                                           \
+    ringq_stats_t stats;                                                        \
+} name##_t;                                                                     \
+                                                                                \
+static inline void name##_init(name##_t *rb) {                                  \
+    rb->head = rb->tail = 0;                                                    \
+    ringq_stats_init(&rb->stats, (capacity));                                   \
+}                                                                               \
+                                                                                \
+static inline void name##_register(name##_t *rb, const char *label) {           \
+    ringq_register(&rb->stats, label);                                          \
+}                                                                               \
+                                                                                \
+static inline unsigned int name##_count(const name##_t *rb) {                   \
+    return rb->tail - rb->head;                                                 \
+}                                                                               \
+                                                                                \
+static inline bool name##_empty(const name##_t *rb) {                           \
+    return rb->tail == rb->head;                                                \
+}                                                                               \
+                                                                                \
+static inline bool name##_full(const name##_t *rb) {                            \
+    return rb->tail - rb->head == (capacity);                                   \
+}                                                                               \
+                                                                                \
+static inline bool name##_enqueue(name##_t *rb, type elem) {                    \
+    unsigned int tail = rb->tail;                                               \
+    unsigned int count = tail - rb->head;                                       \
+    if (count == (capacity)) {                                                  \
+        rb->stats.overflows++;                                                  \
+        return false;                                                           \
+    }                                                                           \
+    ringq_acquire(); /* slot is free only once head was read */                 \
+    rb->entries[tail & ((capacity) - 1)] = elem;                                \
+    ringq_release();                                                            \
+    rb->tail = tail + 1;                                                        \
+    rb->stats.enqueued++;                                                       \
+    ringq_stats_level(&rb->stats, count + 1);                                   \
+    return true;                                                                \
+}                                                                               \
+                                                                                \
+static inline type *name##_claim(name##_t *rb) {                                \
+    unsigned int tail = rb->tail;                                               \
+    if (tail - rb->head == (capacity)) {                                        \
+        rb->stats.overflows++;                                                  \
+        return NULL;                                                            \
+    }                                                                           \
+    ringq_acquire();                                                            \
+    return &rb->entries[tail & ((capacity) - 1)];                               \
+}                                                                               \
+                                                                                \
+static inline void name##_publish(name##_t *rb) {                               \
+    unsigned int tail = rb->tail;                                               \
+    ringq_release();                                                            \
+    rb->tail = tail + 1;                                                        \
+    rb->stats.enqueued++;                                                       \
+    ringq_stats_level(&rb->stats, tail + 1 - rb->head);                         \
+}                                                                               \
+                                                                                \
+static inline bool name##_peek(name##_t *rb, type *p_elem) {                    \
+    unsigned int head = rb->head;                                               \
+    if (rb->tail == head)                                                       \
+        return false;                                                           \
+    ringq_acquire();                                                            \
+    *p_elem = rb->entries[head & ((capacity) - 1)];                             \
+    return true;                                                                \
+}                                                                               \
+                                                                                \
+static inline bool name##_dequeue(name##_t *rb, type *p_elem) {                 \
+    unsigned int head = rb->head;                                               \
+    if (rb->tail == head)                                                       \
+        return false;                                                           \
+    ringq_acquire();                                                            \
+    *p_elem = rb->entries[head & ((capacity) - 1)];                             \
+    ringq_release();                                                            \
+    rb->head = head + 1;                                                        \
+    rb->stats.dequeued++;                                                       \
+    return true;                                                                \
+}                                                                               \
+                                                                                \
+static inline size_t name##_enqueue_bulk(name##_t *rb, type const *elems,       \
+        size_t n) {                                                             \
+    unsigned int tail = rb->tail;                                               \
+    unsigned int count = tail - rb->head;                                       \
+    size_t space = (capacity) - count;                                          \
+    if (n > space) {                                                            \
+        rb->stats.overflows += n - space;                                       \
+        n = space;                                                              \
+    }                                                                           \
+    ringq_acquire();                                                            \
+    for (size_t i = 0; i < n; i++)                                              \
+        rb->entries[(tail + i) & ((capacity) - 1)] = elems[i];                  \
+    ringq_release();                                                            \
+    rb->tail = tail + n;                                                        \
+    rb->stats.enqueued += n;                                                    \
+    ringq_stats_level(&rb->stats, count + n);                                   \
+    return n;                                                                   \
+}                                                                               \
+                                                                                \
+static inline size_t name##_dequeue_bulk(name##_t *rb, type *elems, size_t n) { \
+    unsigned int head = rb->head;                                               \
+    size_t avail = rb->tail - head;                                             \
+    if (n > avail)                                                              \
+        n = avail;                                                              \
+    ringq_acquire();                                                            \
+    for (size_t i = 0; i < n; i++)                                              \
+        elems[i] = rb->entries[(head + i) & ((capacity) - 1)];                  \
+    ringq_release();                                                            \
+    rb->head = head + n;                                                        \
+    rb->stats.dequeued += n;                                                    \
+    return n;                                                                   \
+}
+
+#define RINGQ_MPSC_DECLARE(name, type, capacity)                                \
+                                                                                \
+_Static_assert((capacity) > 0 && ((capacity) & ((capacity) - 1)) == 0,         \
+        #name ": capacity must be a power of two");                             \
+                                                                                \
+typedef struct {                                                                \
+    struct {                                                                    \
+        /* position + 1 once published, position + capacity once consumed */    \
+        volatile unsigned int seq;                                              \
+        type value;                                                             \
+    } slots[capacity];                                                          \
+    volatile unsigned int tail; /* next position to reserve (writers) */        \
+    volatile unsigned int head; /* next position to read (reader) */            \
+    ringq_stats_t stats;                                                        \
+} name##_t;                                                                     \
+                                                                                \
+static inline void name##_init(name##_t *rb) {                                  \
+    for (unsigned int i = 0; i < (capacity); i++)                               \
+        rb->slots[i].seq = i;                                                   \
+    rb->head = rb->tail = 0;                                                    \
+    ringq_stats_init(&rb->stats, (capacity));                                   \
+}                                                                               \
+                                                                                \
+static inline void name##_register(name##_t *rb, const char *label) {           \
+    ringq_register(&rb->stats, label);                                          \
+}                                                                               \
+                                                                                \
+static inline bool name##_enqueue(name##_t *rb, type elem) {                    \
+    unsigned int pos = rb->tail;                                                \
+    while (1) {                                                                 \
+        unsigned int seq = rb->slots[pos & ((capacity) - 1)].seq;               \
+        ringq_acquire();                                                        \
+        int diff = (int)(seq - pos);                                            \
+        if (diff == 0) {                                                        \
+            /* slot is free, try to reserve it (pos is updated on failure) */   \
+            if (ringq_cas(&rb->tail, &pos, pos + 1))                            \
+                break;                                                          \
+        } else if (diff < 0) {                                                  \
+            /* full: slot not consumed since last lap */                        \
+            ringq_add(&rb->stats.overflows, 1);                                 \
+            return false;                                                       \
+        } else {                                                                \
+            pos = rb->tail; /* another writer took it, try again */             \
+        }                                                                       \
+    }                                                                           \
+    rb->slots[pos & ((capacity) - 1)].value = elem;                             \
+    ringq_release();                                                            \
+    rb->slots[pos & ((capacity) - 1)].seq = pos + 1;                            \
+    ringq_add(&rb->stats.enqueued, 1);                                          \
+    /* approximate: the reader or other writers may move on meanwhile */        \
+    int level = (int)(pos + 1 - rb->head);                                      \
+    if (level > 0)                                                              \
+        ringq_stats_level(&rb->stats, level);                                   \
+    return true;                                                                \
+}                                                                               \
+                                                                                \
+static inline bool name##_peek(name##_t *rb, type *p_elem) {                    \
+    unsigned int pos = rb->head;                                                \
+    if (rb->slots[pos & ((capacity) - 1)].seq != pos + 1)                       \
+        return false; /* empty, or next slot not published yet */               \
+    ringq_acquire();                                                            \
+    *p_elem = rb->slots[pos & ((capacity) - 1)].value;                          \
+    return true;                                                                \
+}                                                                               \
+                                                                                \
+static inline bool name##_dequeue(name##_t *rb, type *p_elem) {                 \
+    unsigned int pos = rb->head;                                                \
+    if (!name##_peek(rb, p_elem))                                               \
+        return false;                                                           \
+    ringq_release();                                                            \
+    rb->slots[pos & ((capacity) - 1)].seq = pos + (capacity);                   \
+    rb->head = pos + 1;                                                         \
+    rb->stats.dequeued++;                                                       \
+    return true;                                                                \
+}                                                                               \
+                                                                                \
+static inline bool name##_empty(name##_t *rb) {                                 \
+    unsigned int pos = rb->head;                                                \
+    return rb->slots[pos & ((capacity) - 1)].seq != pos + 1;                    \
+}
+
+#endif
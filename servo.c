@@ -0,0 +1,110 @@
+/*
+ * Servo buzzer driven by the HSTIMER1 interrupt (see servo.h).
+ */
+#include "servo.h"
+#include "hstimer.h"
+#include "interrupts.h"
+#include "irq.h"
+#include "timer.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// delay to get the interrupt going when starting
+#define START_USEC 10
+
+static struct {
+    gpio_id_t pin;
+    volatile bool busy;
+    bool buzzing;           // pulses (buzz) or not (pause)
+    bool high;              // in the middle of a pulse
+    unsigned long end;      // ticks
+    int pulse_a;            // width of the next pulse
+    int pulse_b;            // and of the one after
+} module;
+
+/*
+ * Makes the timer interrupt fire in `usec` microseconds.
+ */
+static void program_timer(long usec) {
+    hstimer_disable(SERVO_HSTIMER);
+    hstimer_init(SERVO_HSTIMER, usec);
+    hstimer_enable(SERVO_HSTIMER);
+}
+
+static void handle_timer(uintptr_t pc, void *aux_data) {
+    hstimer_interrupt_clear(SERVO_HSTIMER);
+
+    if (module.high) {
+        // end of a pulse: low for the rest of the period
+        gpio_write(module.pin, 0);
+        module.high = false;
+        program_timer(SERVO_PERIOD_USEC - module.pulse_a);
+
+        int tmp = module.pulse_a;
+        module.pulse_a = module.pulse_b;
+        module.pulse_b = tmp;
+        return;
+    }
+
+    long remaining = (long)(module.end - timer_get_ticks()) / TICKS_PER_USEC;
+
+    if (remaining <= 0) {
+        hstimer_disable(SERVO_HSTIMER);
+        module.busy = false;
+    } else if (module.buzzing) {
+        // start of a period
+        gpio_write(module.pin, 1);
+        module.high = true;
+        program_timer(module.pulse_a);
+    } else {
+        program_timer(remaining);
+    }
+}
+
+/*
+ * Starts a buzz or a pause. If a pulse is being sent, it is finished first
+ * (the interrupt picks up the new segment at the end of its period).
+ */
+static void start(bool buzzing, unsigned long usec) {
+    unsigned long flags = irq_save();
+
+    module.buzzing = buzzing;
+    module.end = timer_get_ticks() + usec * TICKS_PER_USEC;
+    module.busy = true;
+
+    if (!module.high)
+        program_timer(START_USEC);
+
+    irq_restore(flags);
+}
+
+void servo_init(gpio_id_t pin) {
+    module.pin = pin;
+    gpio_set_output(pin);
+    gpio_write(pin, 0);
+
+    module.busy = false;
+    module.high = false;
+    module.pulse_a = SERVO_PULSE_LONG_USEC;
+    module.pulse_b = SERVO_PULSE_SHORT_USEC;
+
+    hstimer_init(SERVO_HSTIMER, SERVO_PERIOD_USEC);
+    interrupts_register_handler(INTERRUPT_SOURCE_HSTIMER1, handle_timer, NULL);
+    interrupts_enable_source(INTERRUPT_SOURCE_HSTIMER1);
+}
+
+void servo_buzz(unsigned long usec) {
+    start(true, usec);
+}
+
+void servo_pause(unsigned long usec) {
+    start(false, usec);
+}
+
+void servo_stop(void) {
+    start(false, 0);
+}
+
+bool servo_busy(void) {
+    return module.busy;
+}
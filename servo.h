@@ -0,0 +1,64 @@
+#ifndef SERVO_H
+#define SERVO_H
+
+/*
+ * Module to buzz a hobby servo as a haptic actuator. The servo is commanded
+ * with a pulse every SERVO_PERIOD_USEC; alternating between two pulse widths
+ * makes it jerk back and forth, which is felt as a buzz.
+ *
+ * The pulse train is generated from the HSTIMER1 interrupt, so starting a buzz
+ * returns immediately and the timing of the pulses does not depend on what
+ * the main program is doing. A buzz or pause runs for a given duration and
+ * then the servo becomes idle, so a pattern is played by giving it the next
+ * segment whenever servo_busy() returns `false`.
+ *
+ * NOTE: Remember to call interrupts_init and interrupts_global_enable!
+ */
+
+#include "gpio.h"
+#include <stdbool.h>
+
+#define SERVO_HSTIMER HSTIMER1
+
+#define SERVO_PULSE_LONG_USEC   1000
+#define SERVO_PULSE_SHORT_USEC  1200
+#define SERVO_PERIOD_USEC       (20 * 1000)
+
+/*
+ * `servo_init` sets up the servo pin and the timer interrupt.
+ *
+ * @param pin   the GPIO pin the servo signal is connected to
+ */
+void servo_init(gpio_id_t pin);
+
+/*
+ * `servo_buzz` buzzes for (at least) `usec` microseconds, ending at the end of
+ * a pulse period. Replaces whatever the servo was doing.
+ *
+ * @param usec  duration of the buzz
+ */
+void servo_buzz(unsigned long usec);
+
+/*
+ * `servo_pause` keeps the servo still for `usec` microseconds. Replaces
+ * whatever the servo was doing. Useful as a gap between buzzes, since the
+ * servo stays busy meanwhile.
+ *
+ * @param usec  duration of the pause
+ */
+void servo_pause(unsigned long usec);
+
+/*
+ * `servo_stop` stops the current buzz or pause (after the pulse being sent,
+ * if any).
+ */
+void servo_stop(void);
+
+/*
+ * `servo_busy` checks whether a buzz or pause is still running.
+ *
+ * @return      `true` until the current buzz or pause is over
+ */
+bool servo_busy(void);
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+/*
+ * Byte transports that the JNXU protocol can run on top of.
+ *
+ * A transport is a table of functions which move raw bytes between the two
+ * ends of a link. JNXU only talks to the link through this table, so the same
+ * protocol code runs over the HC module (bt_ext), the console UART, an
+ * in-memory loopback or (when compiled on a Linux host) a pseudo-terminal.
+ *
+ * Receiving:
+ * Transports backed by an interrupt (bt_ext) call the rx callback from the
+ * interrupt handler whenever one of the trigger bytes arrives (or too many
+ * bytes arrive without one). Transports without an interrupt implement `poll`
+ * instead, which calls the rx callback if there is data available, and must be
+ * called regularly by the client (see `jnxu_poll`).
+ */
+
+#include "bt_ext.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*transport_rx_fn_t)(void);
+
+// called (possibly from an interrupt) when the link comes up or goes down
+typedef void (*transport_link_fn_t)(bool connected);
+
+typedef struct {
+    // name of the transport, for debugging purposes
+    const char *name;
+
+    // sends `len` bytes from `buf`, blocking until they are all queued.
+    // Returns the number of bytes accepted, less than `len` if the rest had to
+    // be dropped.
+    size_t (*send)(const uint8_t *buf, size_t len);
+
+    // reads up to `len` bytes into `buf`, returns the number of bytes read
+    size_t (*read)(uint8_t *buf, size_t len);
+
+    // returns `true` if there is data to be read
+    bool (*has_data)(void);
+
+    // returns `true` if the link is believed to be up
+    bool (*connected)(void);
+
+    // registers the function to be called whenever the link comes up or goes
+    // down, so that clients need not poll `connected`. NULL if the transport
+    // never changes state on its own.
+    void (*register_link_callback)(transport_link_fn_t fn);
+
+    // tries to (re)connect, blocking for a while. Returns `true` if connected.
+    // NULL if the transport cannot be reconnected.
+    bool (*connect)(void);
+
+    // tells the transport that the other end answered, so the link is up even
+    // though the transport itself did not notice. May be NULL.
+    void (*confirm_connected)(void);
+
+    // registers the function to be called when data arrives. `triggers` lists
+    // the bytes after which the callback should be called as soon as possible.
+    // Transports without interrupts may ignore the triggers.
+    void (*register_rx_callback)(transport_rx_fn_t fn, const uint8_t *triggers, size_t ntriggers);
+
+    // calls the rx callback if there is data. NULL for interrupt-driven
+    // transports (calling the callback from outside the handler would race
+    // with it).
+    void (*poll)(void);
+} transport_t;
+
+/*
+ * `transport_bt_init` initializes bt_ext and returns the transport for it.
+ *
+ * @param role  role of the device in the Bluetooth connection
+ * @param mac   MAC address of the other device (if role is PRIMARY, otherwise
+ *                  this parameter is ignored and can be NULL)
+ * @return      the transport
+ */
+const transport_t *transport_bt_init(bt_ext_role_t role, const char *mac);
+
+/*
+ * `transport_uart_init` returns a transport over the console UART (the one
+ * used by printf). Bytes are sent raw, without newline translation. The UART
+ * must have been initialized with uart_init.
+ *
+ * @return  the transport
+ */
+const transport_t *transport_uart_init(void);
+
+/*
+ * `transport_loopback_init` returns a transport in which every byte sent is
+ * received back by the same device. Useful to exercise and measure the
+ * protocol without any hardware.
+ *
+ * @return  the transport
+ */
+const transport_t *transport_loopback_init(void);
+
+/*
+ * `transport_pty_init` (Linux host only) returns a transport over a
+ * pseudo-terminal.
+ *
+ * @param path  path of the terminal to open (i.e. the /dev/pts/N printed by
+ *                  the other end), or NULL to create a new pseudo-terminal and
+ *                  print the path of its other end.
+ * @return      the transport, or NULL if the terminal could not be opened
+ */
+const transport_t *transport_pty_init(const char *path);
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * Transport over the HC module, using bt_ext.
+ */
+#include "transport.h"
+#include "bt_ext.h"
+#include "strings.h"
+#include "timer.h"
+
+#define RECONNECT_DELAY_USEC (5 * 1000 * 1000) // 5 seconds
+#define RECONNECT_CHECKS 10
+#define RECONNECT_RETRIES 1 // after much testing, we found retries are typically a bad idea.
+
+extern void bt_ext_force_set_connected(void);
+
+static struct {
+    bt_ext_role_t role;
+    char mac[13];
+    transport_link_fn_t link_fn;
+} module;
+
+static size_t bt_send(const uint8_t *buf, size_t len) {
+    bt_ext_send_raw_array(buf, len);
+    return len;
+}
+
+static size_t bt_read(uint8_t *buf, size_t len) {
+    // bt_ext_read reserves one byte for the null-terminator, so at most len - 1
+    // bytes are read, which is fine since the caller keeps reading until empty
+    return bt_ext_read(buf, len);
+}
+
+static bool bt_connect(void) {
+    for (int i = 0; i < RECONNECT_RETRIES; i++) {
+        if (bt_ext_connected()) {
+            return true;
+        }
+
+        bt_ext_connect(module.role, module.mac);
+
+        // give time to connect, but leave if we are connected earlier
+        for (int i = 0; i < RECONNECT_CHECKS; i++) {
+            if (bt_ext_connected()) {
+                return true;
+            }
+
+            timer_delay_us(RECONNECT_DELAY_USEC / RECONNECT_CHECKS);
+        }
+    }
+
+    return false;
+}
+
+static void bt_link_changed(bt_ext_link_event_t event, unsigned long ticks, void *aux_data) {
+    if (module.link_fn != NULL)
+        module.link_fn(event == BT_EXT_LINK_CONNECTED);
+}
+
+static void bt_register_link_callback(transport_link_fn_t fn) {
+    module.link_fn = fn;
+    bt_ext_register_link_handler(bt_link_changed, NULL);
+}
+
+static void bt_register_rx_callback(transport_rx_fn_t fn, const uint8_t *triggers, size_t ntriggers) {
+    for (size_t i = 0; i < ntriggers; i++) {
+        bt_ext_register_trigger(triggers[i], fn);
+    }
+
+    // avoid the ringbuffer filling up if no trigger arrives
+    bt_ext_register_fallback_trigger(fn);
+}
+
+static const transport_t TRANSPORT = {
+    .name = "bt_ext",
+    .send = bt_send,
+    .read = bt_read,
+    .has_data = bt_ext_has_data,
+    .connected = bt_ext_connected,
+    .register_link_callback = bt_register_link_callback,
+    .connect = bt_connect,
+    .confirm_connected = bt_ext_force_set_connected,
+    .register_rx_callback = bt_register_rx_callback,
+    .poll = NULL,
+};
+
+const transport_t *transport_bt_init(bt_ext_role_t role, const char *mac) {
+    module.role = role;
+    if (mac != NULL) {
+        memcpy(module.mac, mac, sizeof(module.mac));
+    }
+
+    bt_ext_init();
+    return &TRANSPORT;
+}
@@ -0,0 +1,98 @@
+/*
+ * Transport over a Linux pseudo-terminal, so that JNXU can be run and measured
+ * on a host. Only compiles on a host (see `make host`).
+ */
+#define _GNU_SOURCE
+#include "transport.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+static struct {
+    int fd;
+    transport_rx_fn_t rx_fn;
+} module = { .fd = -1 };
+
+static size_t pty_send(const uint8_t *buf, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = write(module.fd, buf + sent, len - sent);
+        if (n < 0 && errno == EAGAIN) {
+            // terminal buffer is full, wait until it drains
+            struct pollfd pfd = { .fd = module.fd, .events = POLLOUT };
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        if (n < 0)
+            break; // i.e. the other end closed (EIO), the rest is dropped
+        sent += n;
+    }
+    return sent;
+}
+
+static size_t pty_read(uint8_t *buf, size_t len) {
+    ssize_t n = read(module.fd, buf, len);
+    return n > 0 ? n : 0;
+}
+
+static bool pty_has_data(void) {
+    // once the other end closed, the terminal stays readable but every read
+    // fails, so it counts as empty
+    struct pollfd pfd = { .fd = module.fd, .events = POLLIN };
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN) && !(pfd.revents & POLLHUP);
+}
+
+static bool pty_connected(void) {
+    return module.fd >= 0;
+}
+
+static void pty_register_rx_callback(transport_rx_fn_t fn, const uint8_t *triggers, size_t ntriggers) {
+    module.rx_fn = fn;
+}
+
+static void pty_poll(void) {
+    if (module.rx_fn != NULL && pty_has_data()) {
+        module.rx_fn();
+    }
+}
+
+static const transport_t TRANSPORT = {
+    .name = "pty",
+    .send = pty_send,
+    .read = pty_read,
+    .has_data = pty_has_data,
+    .connected = pty_connected,
+    .register_link_callback = NULL,
+    .connect = NULL,
+    .confirm_connected = NULL,
+    .register_rx_callback = pty_register_rx_callback,
+    .poll = pty_poll,
+};
+
+const transport_t *transport_pty_init(const char *path) {
+    if (path == NULL) {
+        module.fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (module.fd < 0 || grantpt(module.fd) < 0 || unlockpt(module.fd) < 0)
+            return NULL;
+        printf("pty: other end is %s\n", ptsname(module.fd));
+        fflush(stdout);
+    } else {
+        module.fd = open(path, O_RDWR | O_NOCTTY);
+        if (module.fd < 0)
+            return NULL;
+    }
+
+    // raw mode: no echo, no line buffering, no translation of any byte
+    struct termios tio;
+    tcgetattr(module.fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(module.fd, TCSANOW, &tio);
+
+    fcntl(module.fd, F_SETFL, fcntl(module.fd, F_GETFL) | O_NONBLOCK);
+
+    return &TRANSPORT;
+}
@@ -0,0 +1,57 @@
+/*
+ * Transport over the console UART (polled, no interrupts).
+ */
+#include "transport.h"
+#include "uart.h"
+
+static struct {
+    transport_rx_fn_t rx_fn;
+} module;
+
+static size_t uart_transport_send(const uint8_t *buf, size_t len) {
+    // uart_send does not translate \n into \r\n, unlike uart_putchar
+    for (size_t i = 0; i < len; i++) {
+        uart_send(buf[i]);
+    }
+    return len;
+}
+
+static size_t uart_transport_read(uint8_t *buf, size_t len) {
+    size_t n = 0;
+    while (n < len && uart_haschar()) {
+        buf[n++] = uart_recv();
+    }
+    return n;
+}
+
+static bool uart_transport_connected(void) {
+    // a wire is always connected
+    return true;
+}
+
+static void uart_transport_register_rx_callback(transport_rx_fn_t fn, const uint8_t *triggers, size_t ntriggers) {
+    module.rx_fn = fn;
+}
+
+static void uart_transport_poll(void) {
+    if (module.rx_fn != NULL && uart_haschar()) {
+        module.rx_fn();
+    }
+}
+
+static const transport_t TRANSPORT = {
+    .name = "uart",
+    .send = uart_transport_send,
+    .read = uart_transport_read,
+    .has_data = uart_haschar,
+    .connected = uart_transport_connected,
+    .register_link_callback = NULL,
+    .connect = NULL,
+    .confirm_connected = NULL,
+    .register_rx_callback = uart_transport_register_rx_callback,
+    .poll = uart_transport_poll,
+};
+
+const transport_t *transport_uart_init(void) {
+    return &TRANSPORT;
+}
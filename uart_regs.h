@@ -0,0 +1,50 @@
+#ifndef UART_REGS_H
+#define UART_REGS_H
+
+/*
+ * Register layout of the UART peripherals of the Mango Pi, for modules which
+ * drive a UART directly instead of through uart.h (bt_ext for the HC module,
+ * and chess to receive from the host with interrupts).
+ *
+ * Adapted from the provided uart.c module (by Julie Zelenski).
+ */
+
+#include <stdint.h>
+
+// structs defined to match layout of hardware registers
+typedef union {
+    struct {
+        union {
+            uint32_t rbr;   // receive buffer register
+            uint32_t thr;   // transmit holding register
+            uint32_t dll;   // divisor latch (LSB)
+        };
+        union {
+            uint32_t dlh;   // divisor latch (MSB)
+            uint32_t ier;   // interrupt enable register
+        };
+        union {
+            uint32_t iir;   // interrupt identification register
+            uint32_t fcr;   // FIFO control register
+        };
+        uint32_t lcr;       // line control register
+        uint32_t mcr;       // modem control register
+        uint32_t lsr;       // line status register
+        uint32_t reserved[25];
+        uint32_t usr;       // busy status, at offset 0x7c
+        uint32_t reserved2[9];
+        uint32_t halt;      // at offset 0xa4
+    } regs;
+    unsigned char padding[0x400];
+} uart_t;
+
+#define UART_BASE ((uart_t *)0x02500000) // UART0 (console), UART1 follows, etc.
+
+#define LCR_DLAB            (1 << 7)
+#define USR_BUSY            (1 << 0)
+#define USR_TX_NOT_FULL     (1 << 1)
+#define USR_TX_NOT_EMPTY    (1 << 2)
+#define USR_RX_NOT_EMPTY    (1 << 3)
+#define IER_RX_AVAILABLE    (1 << 0)
+
+#endif